@@ -1,6 +1,41 @@
 #ifndef arg_h
 #define arg_h
 
+/**
+ * Command option. Options are given as "--name value" or "--name=value",
+ * flags (has_arg == 0) as "--name". Option with "short_name" may be also given
+ * as "-x value" or "-xvalue".
+ */
+typedef struct arg_opt {
+  const char *name;
+  int has_arg;
+  const char *value; // NULL if option is not given, "" for given flag
+  char short_name;
+} arg_opt_t;
 
+/**
+ * @brief Parse options
+ *
+ * Parse options placed anywhere in argv. Arguments which are not options are
+ * moved to the end of argv in original order. "--" ends options and is
+ * consumed, single "-" is not option (stdin). On error print message and
+ * exit.
+ *
+ * @param[in] argc number of arguments
+ * @param[in,out] argv array of arguments
+ * @param[in,out] opts options terminated by entry with NULL name
+ * @return count of consumed arguments, other arguments start from argv[n]
+ */
+int arg_parse(int argc, char **argv, arg_opt_t *opts);
+/**
+ * @brief Parse unsigned integer option value
+ *
+ * On error print message and exit.
+ *
+ * @param[in] opt parsed option
+ * @param[in] def value returned if option is not given
+ * @return option value
+ */
+unsigned long long arg_ull(const arg_opt_t *opt, unsigned long long def);
 
 #endif
@@ -2,9 +2,33 @@
 #define cmd_h
 
 #include "core.h"
+#include "out.h"
+#include "set.h"
 
 typedef int (*cmd_proc_p)(int argc, char **argv);
 typedef void (*cmd_help_proc_p)(void);
+enum { PARSE_SKIP_INVALID = 1 };
+
+/**
+ * Stream callback. "str" is text of token, it is NULL for binary input.
+ */
+typedef void (*parse_proc_p)(const char *str, int len, unsigned int from,
+                             unsigned int to, void *data);
+
+/**
+ * Shard callback, output of shard is written into "out".
+ */
+typedef void (*print_proc_p)(size_t shard, iap_out_t *out, void *data);
+
+/**
+ * IAP_FORMAT_* of files and stdin read by parse_ips* functions, command line
+ * tokens are always text.
+ */
+extern int parse_format;
+/**
+ * IAP_FORMAT_* of command output.
+ */
+extern int print_format;
 
 struct cmd_struct {
   const char *name;
@@ -26,17 +50,103 @@ struct cmd_struct *find_cmd(const char *name);
  * @brief Parse IP addresses from command line arguments.
  *
  * Parse ip address list from command line in many types if error print message
- * and exit. Call this function with arguments start from first ip address
+ * and exit. Call this function with arguments start from first ip address.
+ * Single argument may be file (@file), compiled set (@@file) or stdin (-).
  *
  * @param[in] argc number of arguments
  * @param[in] argv array of arguments
  */
 void parse_ips(int argc, char **argv, iap_t **root);
+/**
+ * @brief Parse IP addresses into flat set.
+ *
+ * Bulk version of parse_ips. Tokens are collected into array which is sorted
+ * and collapsed (duplicated and contained subnets removed) at once. Large
+ * file is parsed by several threads (all cores or IAP_THREADS environment
+ * variable), every thread normalizes its part and parts are merged.
+ *
+ * @param[in] argc number of arguments
+ * @param[in] argv array of arguments
+ * @param[out] set normalized set
+ */
+void parse_ips_set(int argc, char **argv, iap_set_t *set);
+/**
+ * @brief Parse IP addresses into tree in bulk mode.
+ *
+ * Same as parse_ips, but tree is built at once from normalized set. Much
+ * faster for large inputs than inserting every token.
+ *
+ * @param[in] argc number of arguments
+ * @param[in] argv array of arguments
+ * @param[out] root root of new tree
+ */
+void parse_ips_bulk(int argc, char **argv, iap_t **root);
+/**
+ * @brief Parse IP addresses in stream mode.
+ *
+ * Nothing is stored, for every token callback is called with token text and
+ * range of addresses it covers. Memory use does not depend on input size.
+ * With PARSE_SKIP_INVALID flag any character which can not be part of address
+ * delimits tokens and invalid tokens are skipped, so addresses can be picked
+ * from arbitrary text like logs.
+ *
+ * @param[in] argc number of arguments
+ * @param[in] argv array of arguments
+ * @param[in] proc callback
+ * @param[in] data user data
+ * @param[in] flags PARSE_* flags
+ */
+void parse_ips_stream(int argc, char **argv, parse_proc_p proc, void *data,
+                      int flags);
+
+/**
+ * @brief Print set to stdout.
+ *
+ * Print every prefix of set on separate line, or as binary records in
+ * print_format. Large set is split into shards formatted by several threads.
+ *
+ * @param[in] set set to print
+ */
+void print_set(const iap_set_t *set);
+/**
+ * @brief Count of worker threads.
+ *
+ * @return IAP_THREADS environment variable or count of cores
+ */
+int cmd_threads(void);
+/**
+ * @brief Split set into shards for worker threads.
+ *
+ * Shards follow /8 blocks and are balanced by count of prefixes (see
+ * iap_set_shards), there are several shards for every thread.
+ *
+ * @param[in] set normalized set
+ * @param[out] bounds boundaries of shards, free() it after use
+ * @return count of shards, 0 if set is too small or there is one thread
+ */
+size_t shard_set(const iap_set_t *set, size_t **bounds);
+/**
+ * @brief Print shards to stdout in order.
+ *
+ * Shards are run on pool of worker threads with work stealing, every shard
+ * writes into own memory buffer. Buffers are written in order of shards, so
+ * output is the same as from one thread. Shards are run in batches of two per
+ * thread, memory held grows with threads and size of shard, not with output.
+ *
+ * @param[in] n count of shards
+ * @param[in] proc callback writing output of one shard
+ * @param[in] data user data
+ */
+void print_shards(size_t n, print_proc_p proc, void *data);
 
 void cmd_filter_help();
 void cmd_inflate_help();
 void cmd_deflate_help();
 void cmd_invert_help();
+void cmd_lookup_help();
+void cmd_diff_help();
+void cmd_compile_help();
+void cmd_count_help();
 
 /**
  * @brief Invert the addresses in the tree.
@@ -78,6 +188,48 @@ int cmd_deflate(int argc, char **argv);
  * @return 0 on success, -1 on error
  */
 int cmd_inflate(int argc, char **argv);
+/**
+ * @brief Lookup addresses in list of subnets.
+ *
+ * Command procedure to find subnet containing every input address.
+ *
+ * @param r root of tree
+ * @param out output stream
+ * @return 0 on success, -1 on error
+ */
+int cmd_lookup(int argc, char **argv);
+/**
+ * @brief Difference of two lists of subnets.
+ *
+ * Command procedure to find subnets added and removed between two lists.
+ *
+ * @param r root of tree
+ * @param out output stream
+ * @return 0 on success, -1 on error
+ */
+int cmd_diff(int argc, char **argv);
+/**
+ * @brief Count addresses covered by list of subnets.
+ *
+ * Command procedure to print coverage statistics of list of subnets without
+ * expanding it.
+ *
+ * @param r root of tree
+ * @param out output stream
+ * @return 0 on success, -1 on error
+ */
+int cmd_count(int argc, char **argv);
+/**
+ * @brief Compile list of subnets.
+ *
+ * Command procedure to write normalized list of subnets into binary file
+ * which is loaded by other commands without parsing.
+ *
+ * @param r root of tree
+ * @param out output stream
+ * @return 0 on success, -1 on error
+ */
+int cmd_compile(int argc, char **argv);
 /**
  * @brief Help the user.
  *
@@ -1,19 +1,59 @@
 #ifndef core_h
 #define core_h
 
+#include <stddef.h>
+
 #define IAP_BEST_LEN 19
+#define IAP_CIDR_INVALID 255
+// max count of cidr subnets in one range
+#define IAP_RANGE_MAX 62
+// max depth of tree (AVL tree of 2^32 nodes is lower than 48 levels)
+#define IAP_ITER_DEPTH 64
 
+/**
+ * Address with cidr subnet. Also node of the set: AVL tree by default, or
+ * path compressed binary trie when built with IAP_TRIE.
+ */
 typedef struct iap {
   unsigned char a[4], cidr;
   struct iap *l, *r; // right
   int avl_height;
+  unsigned int avl_count; // nodes in subtree
 } iap_t;
 
+/**
+ * Prefix in raw form. "net" is network address in host byte order.
+ */
+typedef struct iap_pfx {
+  unsigned int net;
+  unsigned int cidr;
+} iap_pfx_t;
+
+/**
+ * Token of text buffer: "len" bytes from offset "off".
+ */
+typedef struct iap_tok {
+  size_t off;
+  int len;
+} iap_tok_t;
+
 enum { IAP_WALK_PREORDER = 0, IAP_WALK_INORDER = 1, IAP_WALK_POSTORDER = 2 };
 
 typedef void (*iap_walk_proc_p)(const iap_t *a, int depth, int mode,
                                 void *data);
 
+struct iap_set;
+
+/**
+ * In-order cursor over set members. Nodes whose subtrees are not visited yet
+ * are kept on explicit stack, so no recursion and no callbacks are used.
+ * Tree must not be changed while iterator is used.
+ */
+typedef struct iap_iter {
+  const iap_t *stack[IAP_ITER_DEPTH];
+  int sp;
+} iap_iter_t;
+
 /**
  * @brief Return raw subnet mask
  *
@@ -102,7 +142,8 @@ iap_t *iap_insert(iap_t **root, const iap_t *);
 /**
  * @brief Remove addresses from tree by subnet
  *
- * Remove from tree all addresses that are part of net.
+ * Remove from tree all addresses that are part of net. Removed nodes are
+ * returned into node pool and reused by next inserts.
  *
  * @param[in,out] root root of tree
  * @param[in] net address to prune
@@ -112,7 +153,8 @@ void iap_prune(iap_t **root, const iap_t *net);
 /**
  * @brief Remove address from tree by concrete address and subnet
  *
- * Remove one address from tree by concrete address and subnet.
+ * Remove one address from tree by concrete address and subnet. Removed node is
+ * returned into node pool.
  *
  * @param[in,out] root root of tree
  * @param[in] net address to remove
@@ -122,7 +164,9 @@ void iap_remove(iap_t **root, const iap_t *net);
 /**
  * @brief Free tree
  *
- * Free all memory allocated for tree. "root" will be set to NULL.
+ * Free all memory allocated for tree. "root" will be set to NULL. Tree nodes
+ * are allocated from large chunks, if tree is the only user of node pool all
+ * chunks are released at once without visiting nodes.
  *
  * @param[in,out] root root of tree
  * @return void
@@ -136,6 +180,8 @@ void iap_free(iap_t **root);
  * 1. iap_walk_mode_t::PREORDER
  * 2. iap_walk_mode_t::INORDER
  * 3. iap_walk_mode_t::POSTORDER
+ * With IAP_TRIE backend only set members (trie leaves) are visited, all three
+ * calls are made one after another.
  *
  * @param[in] root root of tree
  * @param[in] proc callback function
@@ -143,6 +189,49 @@ void iap_free(iap_t **root);
  * @return void
  */
 void iap_walk(const iap_t *root, iap_walk_proc_p proc, void *data);
+/**
+ * @brief Start iteration over tree
+ *
+ * Place iterator before first (lowest) member of tree.
+ *
+ * @param[out] it iterator
+ * @param[in] root root of tree
+ * @return void
+ */
+void iap_iter_init(iap_iter_t *it, const iap_t *root);
+/**
+ * @brief Start iteration from address
+ *
+ * Place iterator before first member which contains address "raw" or follows
+ * it, so range query is seek to first address and iap_iter_next until
+ * member starts after last address.
+ *
+ * @param[out] it iterator
+ * @param[in] root root of tree
+ * @param[in] raw raw address
+ * @return void
+ */
+void iap_iter_seek(iap_iter_t *it, const iap_t *root, unsigned int raw);
+/**
+ * @brief Return next member
+ *
+ * Members are returned in ascending order of addresses.
+ *
+ * @param[in,out] it iterator
+ * @return next member or NULL at the end of tree
+ */
+const iap_t *iap_iter_next(iap_iter_t *it);
+/**
+ * @brief Return many next members
+ *
+ * Same as calling iap_iter_next up to "n" times.
+ *
+ * @param[in,out] it iterator
+ * @param[out] out members, room for "n" items
+ * @param[in] n max count of members
+ * @return count of members, less than "n" only at the end of tree
+ */
+size_t iap_iter_next_n(iap_iter_t *it, const iap_t **out, size_t n);
 /**
  * @brief Convert address to string
  *
@@ -168,15 +257,83 @@ int iap_ntoa(const iap_t *net, char *out);
  * @return return length of string or 0 if address is invalid
  */
 int iap_aton(const char *str, int size, iap_t *out);
+/**
+ * @brief Convert many strings to addresses
+ *
+ * Parse tokens of one buffer with the same rules as iap_aton. Whole token must
+ * be valid address, for invalid token (or range) out[i].cidr is set to
+ * IAP_CIDR_INVALID. Uses SSE4.1 when supported by CPU, scalar iap_aton
+ * otherwise.
+ *
+ * @param[in] buf input buffer
+ * @param[in] size size of input buffer
+ * @param[in] tok tokens of buffer
+ * @param[in] n count of tokens
+ * @param[out] out parsed prefixes, n items
+ * @return count of valid tokens
+ */
+size_t iap_aton_batch(const char *buf, size_t size, const iap_tok_t *tok,
+                      size_t n, iap_pfx_t *out);
+/**
+ * @brief Find prefixes containing many addresses
+ *
+ * Binary search in normalized set for group of addresses at once. Steps of
+ * all searches of group are interleaved and next probes are prefetched, so
+ * cache misses of different addresses overlap instead of stalling one
+ * search after another.
+ *
+ * @param[in] set normalized set
+ * @param[in] addrs raw addresses
+ * @param[in] n count of addresses
+ * @param[out] out index of prefix in set or -1 for every address
+ * @return count of found addresses
+ */
+size_t iap_lookup_batch(const struct iap_set *set, const unsigned int *addrs,
+                        size_t n, long *out);
+/**
+ * @brief Count covered addresses below address
+ *
+ * Binary search in prefix sums of set (see iap_set_sums), O(log n).
+ *
+ * @param[in] set normalized set with prefix sums
+ * @param[in] addr raw address
+ * @return count of addresses of set lower than "addr"
+ */
+unsigned long long iap_rank(const struct iap_set *set, unsigned int addr);
+/**
+ * @brief Find k-th covered address
+ *
+ * Binary search in prefix sums of set (see iap_set_sums), O(log n).
+ *
+ * @param[in] set normalized set with prefix sums
+ * @param[in] k rank of address, starting from 0
+ * @param[out] addr raw address
+ * @return 1 if found, 0 if set has not more than "k" addresses
+ */
+int iap_select(const struct iap_set *set, unsigned long long k,
+               unsigned int *addr);
+/**
+ * @brief Split range into cidr subnets
+ *
+ * Split range into minimal sorted list of cidr subnets. Every subnet is found
+ * with a couple of bit operations, there is no loop over addresses.
+ *
+ * @param[in] from raw first address
+ * @param[in] to raw last address
+ * @param[out] out subnets, room for IAP_RANGE_MAX items
+ * @return count of subnets
+ */
+int iap_range_split(unsigned int from, unsigned int to, iap_pfx_t *out);
 /**
  * @brief Append into tree all cidr subnets containing all addresses in range.
  *
- * Append all cidr subnets containing all addresses in range.
+ * Append all cidr subnets containing all addresses in range. Range is split
+ * with iap_range_split and subnets are inserted in ascending order.
  *
  * @param[in] from first address
  * @param[in] to last address
  * @param[in,out] root root of tree
- * @return return count of inserted addresses or 0 if memory allocation failed
+ * @return return count of inserted subnets or 0 if memory allocation failed
  */
 int iap_range_insert(const iap_t *from, const iap_t *to, iap_t **root);
 /**
@@ -0,0 +1,78 @@
+#ifndef frozen_h
+#define frozen_h
+
+#include "core.h"
+#include "set.h"
+
+#include <stddef.h>
+
+/**
+ * Read-only search index of normalized set. Prefixes (u32 address and
+ * prefix length, 8 bytes) are stored in one array in Eytzinger (BFS) order of
+ * implicit balanced tree, node "k" has children "2k" and "2k + 1" and slot 0 is
+ * unused. "rank" maps slot to index of prefix in set. 12 bytes per prefix,
+ * no pointers, top levels of tree share few cache lines.
+ */
+typedef struct iap_frozen {
+  iap_pfx_t *v;
+  unsigned int *rank;
+  size_t n;
+} iap_frozen_t;
+
+/**
+ * @brief Build frozen index
+ *
+ * Set must be normalized and must not change while index is used.
+ *
+ * @param[out] f frozen index
+ * @param[in] set source set
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_frozen_build(iap_frozen_t *f, const iap_set_t *set);
+/**
+ * @brief Free frozen index
+ *
+ * @param[in,out] f frozen index
+ * @return void
+ */
+void iap_frozen_free(iap_frozen_t *f);
+
+/**
+ * @brief Find slot of prefix containing address
+ *
+ * Branchless descent for last prefix starting at or before address. Eight
+ * nodes three levels below are prefetched with one cache line.
+ *
+ * @param[in] f frozen index
+ * @param[in] addr raw address
+ * @return slot of prefix in "v" or 0 if address is not covered
+ */
+static inline size_t iap_frozen_slot(const iap_frozen_t *f,
+                                     unsigned int addr) {
+  size_t k = 1;
+
+  while (k <= f->n) {
+    __builtin_prefetch(f->v + (k << 3));
+    k = 2 * k + (f->v[k].net <= addr);
+  }
+
+  // path bits of "k" are turns, drop left turns after last right turn
+  k >>= __builtin_ffsll(k);
+
+  return k && addr <= iap_pfx_last(&f->v[k]) ? k : 0;
+}
+
+/**
+ * @brief Find prefix containing address
+ *
+ * @param[in] f frozen index
+ * @param[in] addr raw address
+ * @return index of prefix in set or -1 if address is not covered
+ */
+static inline long iap_frozen_find(const iap_frozen_t *f, unsigned int addr) {
+  size_t k = iap_frozen_slot(f, addr);
+
+  return k ? (long)f->rank[k] : -1;
+}
+
+#endif
@@ -10,6 +10,7 @@
   } while (0)
 
 #define SHORT_USAGE                                                            \
-  "iap <command> [options] [args]. Use iap help for more information.\n"
+  "iap [--stats[=FILE]] [--in-format=F] [--out-format=F] <command> [options] " \
+  "[args]. Use iap help for more information.\n"
 
 #endif
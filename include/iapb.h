@@ -0,0 +1,83 @@
+#ifndef iapb_h
+#define iapb_h
+
+#include "lpm.h"
+#include "set.h"
+
+#define IAPB_MAGIC "IAPBSET"
+#define IAPB_VERSION 2
+#define IAPB_BYTE_ORDER 0x01020304U
+
+enum { IAPB_F_INDEX = 1 };
+
+/**
+ * Header of compiled set file. Header is followed by "count" prefixes
+ * (iap_pfx_t), and with IAPB_F_INDEX flag by DIR-24-8 lookup table: 2^24
+ * first level entries and "groups" second level groups of 256 entries. All
+ * numbers are in byte order of machine which compiled the file. Prefixes and
+ * lookup table have own checksums, table is verified only when it is used.
+ */
+struct iapb_header {
+  char magic[8];
+  unsigned int version;
+  unsigned int byte_order;
+  unsigned int flags;
+  unsigned int reserved;
+  unsigned long long count;
+  unsigned long long groups;
+  unsigned long long checksum;       // prefixes
+  unsigned long long index_checksum; // lookup table
+  char pad[8];
+};
+
+/**
+ * Compiled set file mapped into memory
+ */
+struct iap_map {
+  void *addr;
+  size_t size;
+  const struct iapb_header *header;
+  unsigned int *tbl24, *tbl8;
+  int index_state; // 0 lookup table not verified yet, 1 valid, -1 corrupted
+};
+
+/**
+ * @brief Write set into compiled file
+ *
+ * @param[in] path file name
+ * @param[in] set normalized set
+ * @param[in] lpm lookup table to store, may be NULL
+ * @return 1 if success, 0 on error (errno is set)
+ */
+int iapb_write(const char *path, const iap_set_t *set, const iap_lpm_t *lpm);
+/**
+ * @brief Map compiled file into set
+ *
+ * File is mapped copy on write: pages are shared between processes until set
+ * is changed. Set must be empty.
+ *
+ * @param[in] path file name
+ * @param[out] set set pointing into mapped file
+ * @param[out] err error message on failure
+ * @return 1 if success, 0 on error
+ */
+int iapb_load(const char *path, iap_set_t *set, const char **err);
+/**
+ * @brief Verify lookup table of compiled file
+ *
+ * Table is hashed and its entries are checked to point into set and second
+ * level on first call only, result is kept in map.
+ *
+ * @param[in,out] map mapped file with lookup table
+ * @return 1 if checksum of table matches, 0 otherwise
+ */
+int iapb_check_index(struct iap_map *map);
+/**
+ * @brief Unmap compiled file
+ *
+ * @param[in] map mapped file
+ * @return void
+ */
+void iapb_close(struct iap_map *map);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef lpm_h
+#define lpm_h
+
+#include "frozen.h"
+#include "set.h"
+
+#include <stddef.h>
+
+#define IAP_LPM_EXT 0x80000000U
+// sets up to this size use frozen index instead of 64MiB table
+#define IAP_LPM_FROZEN_MAX (1U << 16)
+
+/**
+ * DIR-24-8 lookup table for normalized set. First level has entry for every
+ * /24 block, blocks which contain prefixes longer than /24 point into second
+ * level group of 256 entries. Entry is index of matching prefix plus one, 0
+ * if there is no match. Small sets are searched in frozen index instead
+ * ("tbl24" is NULL), it fits into cache and costs nothing to build.
+ */
+typedef struct iap_lpm {
+  const iap_set_t *set;
+  unsigned int *tbl24;
+  unsigned int *tbl8;
+  size_t groups, cap;
+  int mapped; // tables point into compiled file of set
+  iap_frozen_t frozen;
+} iap_lpm_t;
+
+/**
+ * @brief Build lookup table
+ *
+ * Set must be normalized and must not change while table is used. If set is
+ * loaded from compiled file with index, tables of file are verified and used
+ * as is. Sets up to IAP_LPM_FROZEN_MAX prefixes get frozen index.
+ *
+ * @param[out] lpm lookup table
+ * @param[in] set source set
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_lpm_build(iap_lpm_t *lpm, const iap_set_t *set);
+/**
+ * @brief Free lookup table
+ *
+ * @param[in,out] lpm lookup table
+ * @return void
+ */
+void iap_lpm_free(iap_lpm_t *lpm);
+/**
+ * @brief Check all addresses of range are covered by set
+ *
+ * Range may be covered by several adjacent prefixes.
+ *
+ * @param[in] lpm lookup table
+ * @param[in] from raw first address
+ * @param[in] to raw last address
+ * @return 1 if range is covered, 0 otherwise
+ */
+int iap_lpm_covers(const iap_lpm_t *lpm, unsigned int from, unsigned int to);
+
+/**
+ * @brief Find prefix containing address
+ *
+ * One memory read for prefixes up to /24, two reads for longer ones. Binary
+ * search in frozen index for small sets.
+ *
+ * @param[in] lpm lookup table
+ * @param[in] addr raw address
+ * @return index of prefix in set or -1 if address is not covered
+ */
+static inline long iap_lpm_find(const iap_lpm_t *lpm, unsigned int addr) {
+  unsigned int e;
+
+  if (!lpm->tbl24)
+    return iap_frozen_find(&lpm->frozen, addr);
+
+  e = lpm->tbl24[addr >> 8];
+
+  if (e & IAP_LPM_EXT)
+    e = lpm->tbl8[((size_t)(e & ~IAP_LPM_EXT) << 8) | (addr & 0xff)];
+
+  return (long)e - 1;
+}
+
+#endif
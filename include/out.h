@@ -0,0 +1,280 @@
+#ifndef out_h
+#define out_h
+
+#include "core.h"
+#include "set.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define IAP_OUT_BUFS 2
+// room reserved for one formatted line, longest is range of two addresses
+#define IAP_OUT_LINE_MAX 64
+
+/**
+ * Formats of address streams. Binary formats hold big-endian records: "bin"
+ * is 4-byte address with 1-byte prefix length, "bin32" is bare 4-byte
+ * address.
+ */
+enum { IAP_FORMAT_TEXT = 0, IAP_FORMAT_BIN, IAP_FORMAT_BIN32 };
+
+#define IAP_FORMAT_BIN_SIZE 5
+#define IAP_FORMAT_BIN32_SIZE 4
+
+/**
+ * Buffered output sink. Text is formatted straight into large page aligned
+ * buffers, filled buffers are written together with one writev().
+ */
+typedef struct iap_out {
+  int fd;
+  int format;  // IAP_FORMAT_*
+  size_t size; // size of every buffer
+  char *bufs[IAP_OUT_BUFS];
+  size_t used[IAP_OUT_BUFS]; // text in filled buffers waiting for write
+  int cur;                   // buffer being filled
+  char *p, *end;
+} iap_out_t;
+
+/**
+ * Two digits of every number 0-99
+ */
+extern const char iap_digits2[200];
+
+/**
+ * @brief Format number 0-255
+ *
+ * @param[out] p output, 3 bytes
+ * @param[in] v number
+ * @return end of text
+ */
+static inline char *iap_fmt_u8(char *p, unsigned int v) {
+  if (v >= 100) {
+    *p++ = '0' + v / 100;
+    memcpy(p, &iap_digits2[(v % 100) * 2], 2);
+    return p + 2;
+  }
+
+  if (v >= 10) {
+    memcpy(p, &iap_digits2[v * 2], 2);
+    return p + 2;
+  }
+
+  *p = '0' + v;
+  return p + 1;
+}
+
+/**
+ * @brief Format raw address
+ *
+ * @param[out] p output, 15 bytes
+ * @param[in] raw raw address
+ * @return end of text
+ */
+static inline char *iap_fmt_addr(char *p, unsigned int raw) {
+  p = iap_fmt_u8(p, raw >> 24);
+  *p++ = '.';
+  p = iap_fmt_u8(p, (raw >> 16) & 0xff);
+  *p++ = '.';
+  p = iap_fmt_u8(p, (raw >> 8) & 0xff);
+  *p++ = '.';
+  return iap_fmt_u8(p, raw & 0xff);
+}
+
+/**
+ * @brief Format prefix, prefix length is omitted for /32
+ *
+ * @param[out] p output, IAP_BEST_LEN bytes
+ * @param[in] net raw network address
+ * @param[in] cidr prefix length
+ * @return end of text
+ */
+static inline char *iap_fmt_pfx(char *p, unsigned int net, unsigned int cidr) {
+  p = iap_fmt_addr(p, net);
+  if (cidr != 32) {
+    *p++ = '/';
+    p = iap_fmt_u8(p, cidr);
+  }
+  return p;
+}
+
+/**
+ * @brief Store address in big-endian order
+ *
+ * @param[out] p output, 4 bytes
+ * @param[in] raw raw address
+ * @return end of record
+ */
+static inline char *iap_put_be32(char *p, unsigned int raw) {
+  p[0] = raw >> 24;
+  p[1] = raw >> 16;
+  p[2] = raw >> 8;
+  p[3] = raw;
+  return p + 4;
+}
+
+/**
+ * @brief Load big-endian address
+ *
+ * @param[in] p record, 4 bytes
+ * @return raw address
+ */
+static inline unsigned int iap_get_be32(const unsigned char *p) {
+  return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 |
+         (unsigned int)p[2] << 8 | p[3];
+}
+
+/**
+ * @brief Return format for its name
+ *
+ * @param[in] name "text", "bin" or "bin32"
+ * @return IAP_FORMAT_* or -1 if name is unknown
+ */
+int iap_format_parse(const char *name);
+/**
+ * @brief Open sink
+ *
+ * Sink with negative "fd" keeps all text in memory, its buffer bufs[0] grows
+ * as needed and text is taken from bufs[0] to p before iap_out_close().
+ *
+ * @param[out] o sink
+ * @param[in] fd output file descriptor or -1 for memory
+ * @param[in] format IAP_FORMAT_* of written prefixes
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_out_open(iap_out_t *o, int fd, int format);
+/**
+ * @brief Write filled buffers and start next one
+ *
+ * Called when current buffer has less than requested room. On write error
+ * print message and exit.
+ *
+ * @param[in,out] o sink
+ * @return void
+ */
+void iap_out_next(iap_out_t *o);
+/**
+ * @brief Write all buffered text
+ *
+ * @param[in,out] o sink
+ * @return void
+ */
+void iap_out_flush(iap_out_t *o);
+/**
+ * @brief Write text from caller buffer
+ *
+ * Large text is written straight from "buf" after buffered text, without
+ * copy into sink. Buffer may be reused after return.
+ *
+ * @param[in,out] o sink
+ * @param[in] buf text
+ * @param[in] n length of text
+ * @return void
+ */
+void iap_out_put(iap_out_t *o, const char *buf, size_t n);
+/**
+ * @brief Flush and close sink
+ *
+ * File descriptor is not closed.
+ *
+ * @param[in,out] o sink
+ * @return void
+ */
+void iap_out_close(iap_out_t *o);
+/**
+ * @brief Report prefix which can not be written as bare address
+ *
+ * Print message and exit, bin32 format holds only /32 prefixes.
+ *
+ * @param[in] p prefix
+ * @return void
+ */
+void iap_out_bad_pfx(const iap_pfx_t *p);
+/**
+ * @brief Write every prefix of set
+ *
+ * Lines or records are formatted in runs which fit into current buffer
+ * without checks of room for every line.
+ *
+ * @param[in,out] o sink
+ * @param[in] set set to print
+ * @return void
+ */
+void iap_out_set(iap_out_t *o, const iap_set_t *set);
+
+/**
+ * @brief Return room for at least "n" bytes
+ *
+ * @param[in,out] o sink
+ * @param[in] n needed room, not more than buffer size
+ * @return position to write at, advance o->p after writing
+ */
+static inline char *iap_out_reserve(iap_out_t *o, size_t n) {
+  if ((size_t)(o->end - o->p) < n)
+    iap_out_next(o);
+  return o->p;
+}
+
+/**
+ * @brief Write text
+ *
+ * @param[in,out] o sink
+ * @param[in] s text
+ * @param[in] n length of text
+ * @return void
+ */
+static inline void iap_out_write(iap_out_t *o, const char *s, size_t n) {
+  size_t c;
+
+  while (n) {
+    if (o->p == o->end)
+      iap_out_next(o);
+    c = (size_t)(o->end - o->p) < n ? (size_t)(o->end - o->p) : n;
+    memcpy(o->p, s, c);
+    o->p += c;
+    s += c;
+    n -= c;
+  }
+}
+
+/**
+ * @brief Write prefix and line end, or prefix record
+ *
+ * @param[in,out] o sink
+ * @param[in] p prefix
+ * @return void
+ */
+static inline void iap_out_pfx(iap_out_t *o, const iap_pfx_t *p) {
+  char *s = iap_out_reserve(o, IAP_OUT_LINE_MAX);
+
+  if (o->format == IAP_FORMAT_BIN) {
+    s = iap_put_be32(s, p->net);
+    *s++ = p->cidr;
+  } else if (o->format == IAP_FORMAT_BIN32) {
+    if (p->cidr != 32)
+      iap_out_bad_pfx(p);
+    s = iap_put_be32(s, p->net);
+  } else {
+    s = iap_fmt_pfx(s, p->net, p->cidr);
+    *s++ = '\n';
+  }
+  o->p = s;
+}
+
+/**
+ * @brief Write range of addresses as minimal list of prefixes
+ *
+ * @param[in,out] o sink
+ * @param[in] from raw first address
+ * @param[in] to raw last address
+ * @return void
+ */
+static inline void iap_out_range(iap_out_t *o, unsigned int from,
+                                 unsigned int to) {
+  iap_pfx_t blocks[IAP_RANGE_MAX];
+  int i, n = iap_range_split(from, to, blocks);
+
+  for (i = 0; i < n; i++)
+    iap_out_pfx(o, &blocks[i]);
+}
+
+#endif
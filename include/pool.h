@@ -0,0 +1,91 @@
+#ifndef pool_h
+#define pool_h
+
+#include "core.h"
+#include "stats.h"
+
+#include <stddef.h>
+
+/**
+ * Size of one node pool chunk. 2MiB so chunk can be backed by one huge page.
+ */
+#define IAP_POOL_CHUNK_SIZE (2UL << 20)
+
+struct iap_chunk {
+  struct iap_chunk *next;
+  size_t used;
+  iap_t nodes[];
+};
+
+#define IAP_POOL_CHUNK_NODES                                                   \
+  ((IAP_POOL_CHUNK_SIZE - sizeof(struct iap_chunk)) / sizeof(iap_t))
+
+/**
+ * Node pool shared by all trees. Nodes are carved from the head chunk,
+ * released nodes are linked into freelist through "l" pointer.
+ */
+struct iap_pool {
+  struct iap_chunk *chunks;
+  iap_t *freelist;
+  size_t live;
+};
+
+extern struct iap_pool iap_pool;
+
+/**
+ * @brief Map new chunk for node pool
+ *
+ * @return new chunk or NULL if memory allocation failed
+ */
+struct iap_chunk *iap_chunk_alloc(void);
+/**
+ * @brief Unmap all pool chunks
+ *
+ * All nodes must be unused, every pointer into pool becomes invalid.
+ *
+ * @return void
+ */
+void iap_pool_reset(void);
+
+/**
+ * @brief Take node from pool freelist or from head chunk
+ *
+ * @return new node or NULL if memory allocation failed
+ */
+static inline iap_t *iap_node_alloc(void) {
+  iap_t *t;
+
+  if (iap_pool.freelist) {
+    t = iap_pool.freelist;
+    iap_pool.freelist = t->l;
+  } else {
+    if (!iap_pool.chunks || iap_pool.chunks->used == IAP_POOL_CHUNK_NODES) {
+      struct iap_chunk *c = iap_chunk_alloc();
+      if (!c)
+        return (void *)0;
+      c->next = iap_pool.chunks;
+      c->used = 0;
+      iap_pool.chunks = c;
+    }
+    t = &iap_pool.chunks->nodes[iap_pool.chunks->used++];
+  }
+
+  iap_pool.live++;
+  IAP_STAT_ADD(node_allocs, 1);
+  IAP_STAT_MAX(peak_nodes, iap_pool.live);
+  return t;
+}
+
+/**
+ * @brief Return node into pool freelist
+ *
+ * @param[in] node unused node
+ * @return void
+ */
+static inline void iap_node_release(iap_t *node) {
+  node->l = iap_pool.freelist;
+  iap_pool.freelist = node;
+  iap_pool.live--;
+}
+
+#endif
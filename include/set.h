@@ -0,0 +1,256 @@
+#ifndef set_h
+#define set_h
+
+#include "core.h"
+
+#include <stddef.h>
+
+struct iap_map;
+
+/**
+ * Flat array of prefixes. After iap_set_normalize() prefixes are sorted by
+ * address and disjoint. Set loaded from compiled file points into mapped file
+ * ("map" is set), it is moved to heap on first append. Prefix sums built by
+ * iap_set_sums() are dropped when set is changed.
+ */
+typedef struct iap_set {
+  iap_pfx_t *v;
+  size_t n, cap;
+  struct iap_map *map;
+  unsigned long long *sums; // addresses before every prefix, n + 1 items
+} iap_set_t;
+
+/**
+ * Coverage statistics of normalized set
+ */
+typedef struct iap_count {
+  unsigned long long addresses;   // covered addresses
+  size_t prefixes;                // disjoint prefixes
+  size_t ranges;                  // runs of adjacent prefixes
+  size_t lengths[33];             // prefixes of every prefix length
+  unsigned long long blocks[256]; // covered addresses of every /8
+} iap_count_t;
+
+/**
+ * @brief Return last address of prefix
+ *
+ * @param[in] p prefix
+ * @return raw last address
+ */
+static inline unsigned int iap_pfx_last(const iap_pfx_t *p) {
+  return p->net | ~iap_mask(p->cidr);
+}
+
+/**
+ * @brief Append prefix into set
+ *
+ * Append prefix to the end of array. Set is not normalized after this call.
+ *
+ * @param[in,out] set target set
+ * @param[in] net raw network address
+ * @param[in] cidr prefix length
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_push(iap_set_t *set, unsigned int net, int cidr);
+/**
+ * @brief Append range of addresses into set
+ *
+ * Split range into minimal list of cidr subnets (at most 62) and append them
+ * to the end of array.
+ *
+ * @param[in,out] set target set
+ * @param[in] from raw first address
+ * @param[in] to raw last address
+ * @return count of appended prefixes or 0 if memory allocation failed
+ */
+int iap_set_push_range(iap_set_t *set, unsigned int from, unsigned int to);
+/**
+ * @brief Sort set
+ *
+ * Sort prefixes by address and prefix length with LSD radix sort.
+ *
+ * @param[in,out] set target set
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_sort(iap_set_t *set);
+/**
+ * @brief Remove duplicated and contained prefixes
+ *
+ * Remove in one pass all prefixes which are part of previous prefix. Set must
+ * be sorted.
+ *
+ * @param[in,out] set target set
+ * @return void
+ */
+void iap_set_collapse(iap_set_t *set);
+/**
+ * @brief Sort set and remove duplicated and contained prefixes
+ *
+ * @param[in,out] set target set
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_normalize(iap_set_t *set);
+/**
+ * @brief Merge prefixes into minimal cidr cover
+ *
+ * Merge sibling prefixes in one pass with stack kept in place of array. Set
+ * must be normalized, result is normalized.
+ *
+ * @param[in,out] set target set
+ * @return void
+ */
+void iap_set_aggregate(iap_set_t *set);
+/**
+ * @brief Merge two sets
+ *
+ * Merge sorted arrays in one pass and drop prefixes contained in previous
+ * one. Sets must be normalized, result is normalized.
+ *
+ * @param[in] a first set
+ * @param[in] b second set
+ * @param[out] out union of sets, must be empty
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_merge(const iap_set_t *a, const iap_set_t *b, iap_set_t *out);
+/**
+ * @brief Build complement of part of set
+ *
+ * Collect gaps before prefixes "from" to "to" - 1, and gap after last prefix
+ * if "to" is end of set. Complements of consecutive parts joined in order
+ * are equal to complement of whole set.
+ *
+ * @param[in] set source set
+ * @param[in] from index of first prefix
+ * @param[in] to index after last prefix
+ * @param[out] out complement of part, must be empty
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_invert_part(const iap_set_t *set, size_t from, size_t to,
+                        iap_set_t *out);
+/**
+ * @brief Build complement of set
+ *
+ * Every gap between prefixes is split into minimal list of cidr subnets in
+ * one pass. Set must be normalized, result is normalized.
+ *
+ * @param[in] set source set
+ * @param[out] out complement of set, must be empty
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_invert(const iap_set_t *set, iap_set_t *out);
+/**
+ * @brief Find difference of two sets
+ *
+ * Walk both sets at once and collect addresses which are only in one of them.
+ * Adjacent blocks are joined before split into cidr subnets, so results are
+ * minimal. If "only_a" and "only_b" is the same set, it receives symmetric
+ * difference. Sets must be normalized, results are normalized.
+ *
+ * @param[in] a first set
+ * @param[in] b second set
+ * @param[out] only_a addresses of "a" which are not in "b", must be empty
+ * @param[out] only_b addresses of "b" which are not in "a", must be empty
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_diff(const iap_set_t *a, const iap_set_t *b, iap_set_t *only_a,
+                 iap_set_t *only_b);
+/**
+ * @brief Build prefix sums of set
+ *
+ * Store count of addresses before every prefix, used by iap_rank(),
+ * iap_select() and iap_set_select(). Set must be normalized.
+ *
+ * @param[in,out] set target set
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_sums(iap_set_t *set);
+/**
+ * @brief Find prefix holding k-th covered address
+ *
+ * Binary search in prefix sums, set must have them (see iap_set_sums).
+ *
+ * @param[in] set normalized set with prefix sums
+ * @param[in] k rank of address, starting from 0
+ * @return index of prefix, set->n if set has not more than "k" addresses
+ */
+size_t iap_set_select(const iap_set_t *set, unsigned long long k);
+/**
+ * @brief Count coverage of set
+ *
+ * Collect statistics in one pass over prefixes, time does not depend on
+ * count of covered addresses. Set must be normalized.
+ *
+ * @param[in] set source set
+ * @param[out] c statistics
+ * @return void
+ */
+void iap_set_count(const iap_set_t *set, iap_count_t *c);
+/**
+ * @brief Count coverage of part of set
+ *
+ * Same as iap_set_count for prefixes "from" to "to" - 1. Statistics of
+ * consecutive parts summed by iap_count_add() are equal to statistics of
+ * whole set.
+ *
+ * @param[in] set source set
+ * @param[in] from index of first prefix
+ * @param[in] to index after last prefix
+ * @param[out] c statistics
+ * @return void
+ */
+void iap_set_count_part(const iap_set_t *set, size_t from, size_t to,
+                        iap_count_t *c);
+/**
+ * @brief Add statistics of part of set
+ *
+ * @param[in,out] c statistics
+ * @param[in] part statistics of next part
+ * @return void
+ */
+void iap_count_add(iap_count_t *c, const iap_count_t *part);
+/**
+ * @brief Split set into shards
+ *
+ * Shards follow /8 blocks of address space: blocks with less than "size"
+ * prefixes are joined with next ones, block with more than twice of "size"
+ * is split. Boundaries are indexes of prefixes, shard "k" holds prefixes
+ * bounds[k] to bounds[k + 1] - 1. Set must be normalized.
+ *
+ * @param[in] set source set
+ * @param[in] size wanted count of prefixes in shard
+ * @param[out] bounds boundaries of shards, room for set->n / size + 258
+ * items
+ * @return count of shards
+ */
+size_t iap_set_shards(const iap_set_t *set, size_t size, size_t *bounds);
+/**
+ * @brief Convert prefix to string
+ *
+ * Same as iap_ntoa for raw prefix.
+ *
+ * @param[in] p prefix
+ * @param[out] out output buffer
+ * @return return length of string
+ */
+int iap_pfx_ntoa(const iap_pfx_t *p, char *out);
+/**
+ * @brief Build balanced tree from set
+ *
+ * Build perfectly balanced tree in O(n). Set must be normalized.
+ *
+ * @param[in] set source set
+ * @param[out] root root of new tree
+ * @return 1 if success, 0 if memory allocation failed
+ */
+int iap_set_tree(const iap_set_t *set, iap_t **root);
+/**
+ * @brief Free set
+ *
+ * Free all memory allocated for set.
+ *
+ * @param[in,out] set target set
+ * @return void
+ */
+void iap_set_free(iap_set_t *set);
+
+#endif
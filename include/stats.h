@@ -0,0 +1,82 @@
+#ifndef stats_h
+#define stats_h
+
+/**
+ * Counters of --stats option. Counters are updated only when "on" is set, so
+ * with option off every counter costs one predicted branch. Built with
+ * IAP_NO_STATS counters are removed at all. Commands work on flat sets, tree
+ * counters are reported only when tree nodes were allocated (library and
+ * bench tree paths).
+ */
+struct iap_stats {
+  int on;
+  unsigned long long tokens;       // parsed tokens
+  unsigned long long collapsed;    // duplicate or nested prefixes dropped
+  unsigned long long aggregated;   // prefixes merged with sibling
+  unsigned long long set_allocs;   // set array reallocations
+  unsigned long long inserted;     // new tree members
+  unsigned long long prunes;       // prune operations
+  unsigned long long removed;      // tree members removed by remove or prune
+  unsigned long long rotations;    // AVL rotations
+  unsigned long long node_allocs;  // nodes taken from pool
+  unsigned long long chunk_allocs; // pool chunks mapped
+  unsigned long long peak_nodes;   // max count of live tree nodes
+};
+
+extern struct iap_stats iap_stats;
+
+#ifdef IAP_NO_STATS
+#define IAP_STAT_ADD(name, n) ((void)0)
+#define IAP_STAT_ADD_SHARED(name, n) ((void)0)
+#define IAP_STAT_MAX(name, v) ((void)0)
+#else
+#define IAP_STAT_ADD(name, n)                                                  \
+  do {                                                                         \
+    if (__builtin_expect(iap_stats.on, 0))                                     \
+      iap_stats.name += (n);                                                   \
+  } while (0)
+// counter updated by several threads
+#define IAP_STAT_ADD_SHARED(name, n)                                           \
+  do {                                                                         \
+    if (__builtin_expect(iap_stats.on, 0))                                     \
+      __atomic_fetch_add(&iap_stats.name, (n), __ATOMIC_RELAXED);              \
+  } while (0)
+#define IAP_STAT_MAX(name, v)                                                  \
+  do {                                                                         \
+    if (__builtin_expect(iap_stats.on, 0) && (v) > iap_stats.name)             \
+      iap_stats.name = (v);                                                    \
+  } while (0)
+#endif
+
+/**
+ * @brief Enable statistics
+ *
+ * Start time measurement and counters. Report is printed to stderr, or
+ * written as JSON into "path" if it is not NULL.
+ *
+ * @param[in] command name of command
+ * @param[in] path JSON report file or NULL
+ * @return 1 if success, 0 if built with IAP_NO_STATS
+ */
+int iap_stats_start(const char *command, const char *path);
+/**
+ * @brief Start next phase
+ *
+ * Time from previous call is added to previous phase, phases with same name
+ * are summed. Does nothing if statistics are off.
+ *
+ * @param[in] name name of phase, string must be static
+ * @return void
+ */
+void iap_stats_phase(const char *name);
+/**
+ * @brief Print report
+ *
+ * Close current phase and print report. Called at exit once statistics are
+ * enabled. If report file can not be written, process exits with failure.
+ *
+ * @return void
+ */
+void iap_stats_report(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef work_h
+#define work_h
+
+#include <stddef.h>
+
+#define IAP_WORK_THREADS_MAX 64
+
+/**
+ * Task of iap_work_run(), "task" is index of task
+ */
+typedef void (*iap_work_p)(size_t task, void *data);
+
+/**
+ * @brief Run tasks on pool of threads
+ *
+ * Every thread gets own queue with equal slice of tasks and takes them in
+ * ascending order. Thread with empty queue steals last task of the longest
+ * other queue, so skewed tasks are spread over all threads. Calling thread
+ * is one of workers. Function returns when all tasks are done.
+ *
+ * @param[in] n count of tasks
+ * @param[in] threads count of threads, at most IAP_WORK_THREADS_MAX
+ * @param[in] proc task procedure
+ * @param[in] data user data
+ * @return void
+ */
+void iap_work_run(size_t n, int threads, iap_work_p proc, void *data);
+
+#endif
@@ -1 +1,94 @@
 #include "arg.h"
+#include "iap.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static arg_opt_t *arg_find(arg_opt_t *opts, const char *name, size_t len) {
+  for (; opts->name; opts++) {
+    if (strlen(opts->name) == len && strncmp(opts->name, name, len) == 0)
+      return opts;
+  }
+  return NULL;
+}
+
+static arg_opt_t *arg_find_short(arg_opt_t *opts, char c) {
+  for (; opts->name; opts++) {
+    if (opts->short_name && opts->short_name == c)
+      return opts;
+  }
+  return NULL;
+}
+
+int arg_parse(int argc, char **argv, arg_opt_t *opts) {
+  char **pos = malloc(argc * sizeof(char *) + 1);
+  int i, n = 0, npos = 0, only_pos = 0;
+
+  if (!pos)
+    FAILURE("Error: failed to allocate memory\n");
+
+  for (i = 0; i < argc; i++) {
+    const char *a = argv[i], *name, *value = NULL;
+    arg_opt_t *opt;
+
+    if (only_pos || a[0] != '-' || a[1] == '\0') {
+      pos[npos++] = argv[i];
+      continue;
+    }
+
+    argv[n++] = argv[i];
+
+    if (strcmp(a, "--") == 0) {
+      only_pos = 1;
+      continue;
+    }
+
+    if (a[1] == '-') {
+      name = a + 2;
+      value = strchr(name, '=');
+      opt = arg_find(opts, name, value ? (size_t)(value - name) : strlen(name));
+      if (value)
+        value++;
+    } else {
+      opt = arg_find_short(opts, a[1]);
+      if (a[2] != '\0')
+        value = a + 2;
+    }
+
+    if (!opt)
+      FAILURE("Error: unknown option: %s\n", a);
+
+    if (!opt->has_arg) {
+      if (value)
+        FAILURE("Error: option --%s has no value\n", opt->name);
+      opt->value = "";
+    } else if (value)
+      opt->value = value;
+    else if (i + 1 < argc) {
+      opt->value = argv[++i];
+      argv[n++] = argv[i];
+    } else
+      FAILURE("Error: option --%s requires value\n", opt->name);
+  }
+
+  memcpy(argv + n, pos, npos * sizeof(char *));
+  free(pos);
+  return n;
+}
+
+unsigned long long arg_ull(const arg_opt_t *opt, unsigned long long def) {
+  unsigned long long v;
+  char *end;
+
+  if (!opt->value)
+    return def;
+
+  errno = 0;
+  v = strtoull(opt->value, &end, 10);
+  if (errno || end == opt->value || *end || opt->value[0] == '-')
+    FAILURE("Error: invalid value of option --%s: %s\n", opt->name,
+            opt->value);
+
+  return v;
+}
@@ -0,0 +1,188 @@
+#include "core.h"
+
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IAP_ATON_SSE41
+#include <immintrin.h>
+#endif
+
+/**
+ * parse token with scalar iap_aton. Whole token must be consumed.
+ */
+static int aton_scalar(const char *str, int size, iap_pfx_t *out) {
+  iap_t a = {0};
+
+  if (iap_aton(str, size, &a) != size)
+    return 0;
+
+  out->net = iap_raw(&a);
+  out->cidr = a.cidr;
+  return 1;
+}
+
+#ifdef IAP_ATON_SSE41
+
+/**
+ * Shuffle masks for every combination of octet lengths (1-3 digits each).
+ * Octet k is moved right aligned into 32-bit lane k, free bytes are zeroed.
+ */
+static __m128i aton_shuf[81];
+static int aton_sse41_ok;
+static pthread_once_t aton_once = PTHREAD_ONCE_INIT;
+
+static void aton_init(void) {
+  unsigned char m[16];
+  int idx, k, len[4], start, t, i;
+
+  for (idx = 0; idx < 81; idx++) {
+    for (k = 3, t = idx; k >= 0; k--, t /= 3)
+      len[k] = t % 3 + 1;
+
+    for (k = 0, start = 0; k < 4; k++) {
+      for (i = 0; i < 4; i++)
+        m[k * 4 + i] = 0x80;
+      for (i = 0; i < len[k]; i++)
+        m[k * 4 + 4 - len[k] + i] = start + i;
+      start += len[k] + 1;
+    }
+
+    aton_shuf[idx] = _mm_loadu_si128((const __m128i *)m);
+  }
+
+  __builtin_cpu_init();
+  aton_sse41_ok = __builtin_cpu_supports("sse4.1") != 0;
+}
+
+/**
+ * Parse token with SSE4.1. At least 16 bytes from "str" must be readable.
+ * Return 1 if token is valid address, -1 if token must be checked by scalar
+ * parser (invalid or unusual token).
+ */
+__attribute__((target("sse4.1"))) static int
+aton_sse41(const char *str, int size, iap_pfx_t *out) {
+  __m128i v, d, in, g, s;
+  unsigned int dots, digits, slash, qmask, raw, cidr;
+  int len, d1, d2, d3, l0, l1, l2, l3;
+
+  if (size > 18)
+    return -1;
+
+  v = _mm_loadu_si128((const __m128i *)str);
+  in = _mm_cmpgt_epi8(_mm_set1_epi8(size > 16 ? 16 : size),
+                      _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                    13, 14, 15));
+  d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+
+  dots = _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')), in));
+  slash = _mm_movemask_epi8(
+      _mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')), in));
+  digits = _mm_movemask_epi8(_mm_and_si128(
+      _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d), in));
+
+  // dotted quad is part of token before "/"
+  len = slash ? __builtin_ctz(slash) : size;
+  if (len < 7 || len > 15)
+    return -1;
+
+  qmask = (1U << len) - 1;
+  dots &= qmask;
+  if (((digits | dots) & qmask) != qmask || __builtin_popcount(dots) != 3)
+    return -1;
+
+  d1 = __builtin_ctz(dots);
+  dots &= dots - 1;
+  d2 = __builtin_ctz(dots);
+  dots &= dots - 1;
+  d3 = __builtin_ctz(dots);
+
+  l0 = d1;
+  l1 = d2 - d1 - 1;
+  l2 = d3 - d2 - 1;
+  l3 = len - d3 - 1;
+  if (l0 < 1 || l0 > 3 || l1 < 1 || l1 > 3 || l2 < 1 || l2 > 3 || l3 < 1 ||
+      l3 > 3)
+    return -1;
+
+  // digits into 32-bit lanes as [0, hundreds, tens, units], then
+  // 100 * h + 10 * t + u for every lane
+  g = _mm_shuffle_epi8(
+      d, aton_shuf[(l0 - 1) * 27 + (l1 - 1) * 9 + (l2 - 1) * 3 + (l3 - 1)]);
+  s = _mm_maddubs_epi16(
+      g, _mm_setr_epi8(0, 100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0, 100,
+                       10, 1));
+  s = _mm_madd_epi16(s, _mm_set1_epi16(1));
+
+  if (_mm_movemask_epi8(_mm_cmpgt_epi32(s, _mm_set1_epi32(255))))
+    return -1;
+
+  s = _mm_packus_epi32(s, s);
+  s = _mm_packus_epi16(s, s);
+  raw = __builtin_bswap32((unsigned int)_mm_cvtsi128_si32(s));
+
+  cidr = 32;
+  if (slash) {
+    const char *c = str + len + 1;
+    int clen = size - len - 1;
+
+    if (clen < 1 || clen > 2 || c[0] < '0' || c[0] > '9')
+      return -1;
+
+    cidr = c[0] - '0';
+    if (clen == 2) {
+      if (c[1] < '0' || c[1] > '9')
+        return -1;
+      cidr = cidr * 10 + (c[1] - '0');
+    }
+
+    if (cidr > 32)
+      return -1;
+  }
+
+  if (raw & ~iap_mask(cidr))
+    return -1;
+
+  out->net = raw;
+  out->cidr = cidr;
+  return 1;
+}
+
+#endif
+
+size_t iap_aton_batch(const char *buf, size_t size, const iap_tok_t *tok,
+                      size_t n, iap_pfx_t *out) {
+  size_t i, ok = 0;
+
+#ifdef IAP_ATON_SSE41
+  pthread_once(&aton_once, aton_init);
+
+  if (aton_sse41_ok) {
+    for (i = 0; i < n; i++) {
+      const char *p = buf + tok[i].off;
+
+      // vector load must stay inside buffer
+      if (tok[i].off + 16 <= size && aton_sse41(p, tok[i].len, &out[i]) > 0) {
+        ok++;
+        continue;
+      }
+
+      if (aton_scalar(p, tok[i].len, &out[i]))
+        ok++;
+      else
+        out[i].cidr = IAP_CIDR_INVALID;
+    }
+
+    return ok;
+  }
+#endif
+
+  for (i = 0; i < n; i++) {
+    if (aton_scalar(buf + tok[i].off, tok[i].len, &out[i]))
+      ok++;
+    else
+      out[i].cidr = IAP_CIDR_INVALID;
+  }
+
+  return ok;
+}
@@ -1,11 +1,37 @@
 #include "cmd.h"
 #include "core.h"
+#include "iapb.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
+#include "work.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PARSE_BLOCK_SIZE (1 << 20)
+// longest valid token is range "255.255.255.255-255.255.255.255"
+#define PARSE_TOKEN_MAX 255
+#define PARSE_BATCH 256
+// smallest part of mapped file worth own thread
+#define PARSE_CHUNK_MIN (4 << 20)
+#define PARSE_THREADS_MAX 64
+// smallest shard of set worth own task
+#define SHARD_MIN (1 << 14)
+// largest shard of set, bounds text of one shard held in memory
+#define SHARD_MAX (1 << 15)
+// shards per thread, so skewed shards are balanced by stealing
+#define SHARD_PER_THREAD 8
+// shards per thread formatted into memory before they are written
+#define PRINT_SHARDS_PER_THREAD 2
 
 // clang-format off
 
@@ -14,12 +40,19 @@ struct cmd_struct commands[] = {
     {"filter", "filter list of addresses by subnet.", cmd_filter, cmd_filter_help},
     {"inflate", "inflate (expand list of subnets)", cmd_inflate, cmd_inflate_help},
     {"deflate", "deflate (find subnets)", cmd_deflate, cmd_deflate_help},
+    {"lookup", "lookup addresses in list of subnets", cmd_lookup, cmd_lookup_help},
+    {"diff", "difference of two lists of subnets", cmd_diff, cmd_diff_help},
+    {"count", "count addresses covered by list of subnets", cmd_count, cmd_count_help},
+    {"compile", "compile list of subnets into binary file", cmd_compile, cmd_compile_help},
     {"help", "Show help message", cmd_help, NULL},
     {"list", "List all commands", cmd_list, NULL},
     {NULL}};
 
 // clang-format on
 
+int parse_format = IAP_FORMAT_TEXT;
+int print_format = IAP_FORMAT_TEXT;
+
 struct cmd_struct *find_cmd(const char *name) {
   for (size_t i = 0; commands[i].name; i++) {
     if (strcmp(commands[i].name, name) == 0)
@@ -30,85 +63,623 @@ struct cmd_struct *find_cmd(const char *name) {
 
 struct cmd_struct *list_cmd() { return commands; }
 
-static void parse_fail(iap_t **root, const char *msg, ...) {
+/**
+ * Parse target. Tokens are inserted into tree if "root" is set, appended into
+ * "set" in bulk mode, or passed to "proc" in stream mode.
+ */
+struct parse_ctx {
+  iap_t **root;
+  iap_set_t *set;
+  parse_proc_p proc;
+  void *data;
+  int skip;       // skip invalid characters and tokens instead of failing
+  int normalized; // set was loaded already normalized
+  int discard;    // skipped too long token continues in next block
+};
+
+static pthread_mutex_t parse_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void parse_fail(struct parse_ctx *ctx, const char *msg, ...) {
   va_list va;
+  // only first failed worker reports error, others wait for exit
+  pthread_mutex_lock(&parse_fail_lock);
   va_start(va, msg);
   fwrite("Error: ", strlen("Error: "), 1, stderr);
   vfprintf(stderr, msg, va);
   va_end(va);
-  iap_free(root);
+  if (ctx->root)
+    iap_free(ctx->root);
+  if (ctx->set)
+    iap_set_free(ctx->set);
   putc('\n', stderr);
   exit(EXIT_FAILURE);
 }
 
-static void parse_token(iap_t **root, const char *str) {
+static void parse_pfx(struct parse_ctx *ctx, const iap_pfx_t *p,
+                      const char *str, int len) {
+  iap_t a = {0};
+
+  if (ctx->proc) {
+    ctx->proc(str, len, p->net, iap_pfx_last(p), ctx->data);
+    return;
+  }
+
+  if (ctx->set) {
+    if (!iap_set_push(ctx->set, p->net, p->cidr))
+      parse_fail(ctx, "failed to allocate memory");
+    return;
+  }
+
+  a.a[0] = (p->net >> 24) & 0xff;
+  a.a[1] = (p->net >> 16) & 0xff;
+  a.a[2] = (p->net >> 8) & 0xff;
+  a.a[3] = p->net & 0xff;
+  a.cidr = p->cidr;
+  if (iap_insert(ctx->root, &a) == 0)
+    parse_fail(ctx, "failed to allocate memory");
+}
+
+static void parse_token(struct parse_ctx *ctx, const char *str, int len) {
   iap_t a = {0}, b = {0};
-  if (iap_aton(str, strlen(str), &a) > 0) {
-    if (iap_insert(root, &a) == 0)
-      parse_fail(root, "failed to allocate memory");
-  } else if (iap_range_aton(str, strlen(str), &a, &b) > 0) {
-    if (iap_range_insert(&a, &b, root) == 0)
-      parse_fail(root, "failed to allocate memory");
-  } else {
-    parse_fail(root, "failed to parse input: %s", str);
+  if (iap_aton(str, len, &a) == len) {
+    iap_pfx_t p = {iap_raw(&a), a.cidr};
+    parse_pfx(ctx, &p, str, len);
+  } else if (iap_range_aton(str, len, &a, &b) > 0) {
+    if (ctx->proc)
+      ctx->proc(str, len, iap_raw(&a), iap_raw(&b), ctx->data);
+    else if (ctx->set) {
+      if (!iap_set_push_range(ctx->set, iap_raw(&a), iap_raw(&b)))
+        parse_fail(ctx, "failed to allocate memory");
+    } else if (iap_range_insert(&a, &b, ctx->root) == 0)
+      parse_fail(ctx, "failed to allocate memory");
+  } else if (!ctx->skip) {
+    parse_fail(ctx, "failed to parse input: %.*s", len, str);
   }
 }
 
-void parse_ips(int argc, char **argv, iap_t **root) {
-  // Implementation of the parse_ips function
-  if (argc == 0)
-    return;
+enum { CH_INVALID = 0, CH_IP = 1, CH_DELIM = 2 };
+
+static unsigned char chclass[256], chclass_skip[256];
 
-  FILE *in = stdin;
-  char buffer[256] = {0}, *buffer_p = buffer;
-  int c, i;
+static void chclass_init(void) {
   const char *ipchars = "0123456789./-";
   const char *delimiters = " ,\t\r\n";
+  int i;
 
-  if (argc == 1) {
-    strncpy(buffer, argv[0], sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
+  for (; *ipchars; ipchars++)
+    chclass[(unsigned char)*ipchars] = CH_IP;
+  for (; *delimiters; delimiters++)
+    chclass[(unsigned char)*delimiters] = CH_DELIM;
+
+  // in skip mode every character which can not be part of token delimits
+  for (i = 0; i < 256; i++)
+    chclass_skip[i] = chclass[i] == CH_IP ? CH_IP : CH_DELIM;
+}
+
+/**
+ * Parse collected tokens at once. Tokens which are not single address (ranges
+ * or invalid input) go through parse_token.
+ */
+static void parse_batch(struct parse_ctx *ctx, const char *buf, size_t size,
+                        const iap_tok_t *tok, size_t n) {
+  iap_pfx_t out[PARSE_BATCH];
+  size_t i;
+
+  iap_aton_batch(buf, size, tok, n, out);
+  IAP_STAT_ADD_SHARED(tokens, n);
+
+  for (i = 0; i < n; i++) {
+    if (out[i].cidr == IAP_CIDR_INVALID)
+      parse_token(ctx, buf + tok[i].off, tok[i].len);
+    else
+      parse_pfx(ctx, &out[i], buf + tok[i].off, tok[i].len);
+  }
+}
+
+/**
+ * Parse all tokens of buffer. If "last" is not set, token running to the end
+ * of buffer may continue in next block: it is not parsed and count of its
+ * bytes is returned.
+ */
+static size_t parse_buffer(struct parse_ctx *ctx, const char *buf, size_t size,
+                           int last) {
+  const unsigned char *cls = ctx->skip ? chclass_skip : chclass;
+  const char *p = buf, *end = buf + size, *t;
+  iap_tok_t tok[PARSE_BATCH];
+  size_t n = 0;
+
+  // rest of skipped token is not new token
+  if (ctx->discard) {
+    while (p < end && cls[(unsigned char)*p] == CH_IP)
+      p++;
+    ctx->discard = p == end && !last;
+  }
+
+  while (p < end) {
+    while (p < end && cls[(unsigned char)*p] == CH_DELIM)
+      p++;
+
+    t = p;
+    while (p < end && cls[(unsigned char)*p] == CH_IP)
+      p++;
+
+    if (p - t > PARSE_TOKEN_MAX && ctx->skip) {
+      ctx->discard = p == end && !last;
+      t = p;
+    } else if (p - t > PARSE_TOKEN_MAX) {
+      parse_batch(ctx, buf, size, tok, n);
+      parse_fail(ctx, "failed to parse input: %.*s", PARSE_TOKEN_MAX, t);
+    }
+
+    if (p == end && !last) {
+      parse_batch(ctx, buf, size, tok, n);
+      return p - t;
+    }
+
+    if (p > t) {
+      tok[n].off = t - buf;
+      tok[n].len = p - t;
+      if (++n == PARSE_BATCH) {
+        parse_batch(ctx, buf, size, tok, n);
+        n = 0;
+      }
+    }
+
+    if (p < end && cls[(unsigned char)*p] == CH_INVALID) {
+      parse_batch(ctx, buf, size, tok, n);
+      parse_fail(ctx, "invalid character: %c", *p);
+    }
+  }
+
+  parse_batch(ctx, buf, size, tok, n);
+  return 0;
+}
+
+/**
+ * Parse binary records of buffer (parse_format). Unfinished record at the end
+ * of buffer is not parsed and count of its bytes is returned.
+ */
+static size_t parse_records(struct parse_ctx *ctx, const char *buf,
+                            size_t size) {
+  const unsigned char *p = (const unsigned char *)buf;
+  size_t rec = parse_format == IAP_FORMAT_BIN ? IAP_FORMAT_BIN_SIZE
+                                              : IAP_FORMAT_BIN32_SIZE;
+  size_t i, n = size / rec;
+  iap_pfx_t pfx;
+
+  IAP_STAT_ADD_SHARED(tokens, n);
+
+  for (i = 0; i < n; i++, p += rec) {
+    pfx.net = iap_get_be32(p);
+    pfx.cidr = rec == IAP_FORMAT_BIN_SIZE ? p[4] : 32;
+
+    if (pfx.cidr > 32 || (pfx.net & ~iap_mask(pfx.cidr))) {
+      if (ctx->skip)
+        continue;
+      parse_fail(ctx, "invalid record: %u.%u.%u.%u/%u", p[0], p[1], p[2],
+                 p[3], pfx.cidr);
+    }
+
+    // there is no text of token, callbacks format prefix if needed
+    parse_pfx(ctx, &pfx, (void *)0, 0);
+  }
+
+  return size - n * rec;
+}
+
+/**
+ * Read stream in large blocks. Unfinished token at the end of block is moved
+ * to the start of buffer and completed by next read.
+ */
+static void parse_stream(struct parse_ctx *ctx, int fd) {
+  char *buf = malloc(PARSE_BLOCK_SIZE);
+  size_t used = 0, tail;
+  ssize_t n;
+
+  if (!buf)
+    parse_fail(ctx, "failed to allocate memory");
+
+  for (;;) {
+    n = read(fd, buf + used, PARSE_BLOCK_SIZE - used);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      free(buf);
+      parse_fail(ctx, "failed to read input: %s", strerror(errno));
+    }
+
+    used += n;
+    if (parse_format != IAP_FORMAT_TEXT) {
+      tail = parse_records(ctx, buf, used);
+      if (n == 0 && tail) {
+        free(buf);
+        parse_fail(ctx, "truncated record at end of input");
+      }
+    } else
+      tail = parse_buffer(ctx, buf, used, n == 0);
+    if (n == 0)
+      break;
+
+    memmove(buf, buf + used - tail, tail);
+    used = tail;
+  }
+
+  free(buf);
+}
+
+/**
+ * Part of mapped file parsed by one thread into its own normalized set
+ */
+struct parse_job {
+  const char *buf;
+  size_t size;
+  int skip;
+  iap_set_t set;
+};
+
+/**
+ * Pair of normalized sets, "b" is merged into "a"
+ */
+struct parse_merge {
+  iap_set_t *a, *b;
+};
+
+int cmd_threads(void) {
+  const char *env = getenv("IAP_THREADS");
+  long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n < 1 ? 1 : n > PARSE_THREADS_MAX ? PARSE_THREADS_MAX : n;
+}
+
+static void *parse_job_run(void *arg) {
+  struct parse_job *job = arg;
+  struct parse_ctx ctx = {(void *)0, &job->set, (void *)0, (void *)0,
+                          job->skip};
+
+  parse_buffer(&ctx, job->buf, job->size, 1);
+  if (!iap_set_normalize(&job->set))
+    parse_fail(&ctx, "failed to allocate memory");
+
+  return (void *)0;
+}
+
+static void *parse_merge_run(void *arg) {
+  struct parse_merge *m = arg;
+  struct parse_ctx ctx = {(void *)0, m->a, (void *)0, (void *)0, 0};
+  iap_set_t out = {0};
+
+  if (!iap_set_merge(m->a, m->b, &out))
+    parse_fail(&ctx, "failed to allocate memory");
+
+  iap_set_free(m->a);
+  iap_set_free(m->b);
+  *m->a = out;
+
+  return (void *)0;
+}
+
+/**
+ * run "proc" for every of "n" jobs in own thread, last job runs in calling
+ * thread. Job is run in place if thread can not be created.
+ */
+static void parse_run(void *(*proc)(void *), void *jobs, size_t size,
+                      int n) {
+  pthread_t th[PARSE_THREADS_MAX];
+  int started[PARSE_THREADS_MAX];
+  int i;
+
+  for (i = 0; i < n - 1; i++) {
+    started[i] =
+        pthread_create(&th[i], (void *)0, proc, (char *)jobs + i * size) == 0;
+    if (!started[i])
+      proc((char *)jobs + i * size);
+  }
+
+  if (n > 0)
+    proc((char *)jobs + (n - 1) * size);
+
+  for (i = 0; i < n - 1; i++)
+    if (started[i])
+      pthread_join(th[i], (void *)0);
+}
+
+/**
+ * Parse mapped file into empty set with several threads. File is split into
+ * chunks at token boundaries, every chunk is parsed and normalized by own
+ * thread, then sets are merged pairwise in parallel. Return 0 if file is too
+ * small to be split.
+ */
+static int parse_parallel(struct parse_ctx *ctx, const char *buf,
+                          size_t size) {
+  const unsigned char *cls = ctx->skip ? chclass_skip : chclass;
+  struct parse_job jobs[PARSE_THREADS_MAX] = {0};
+  struct parse_merge merges[PARSE_THREADS_MAX];
+  size_t start = 0, end;
+  int n, i, m, step;
 
-    if (argv[0][0] == '@' && strlen(argv[0]) > 1) {
+  n = cmd_threads();
+  if ((size_t)n > size / PARSE_CHUNK_MIN)
+    n = size / PARSE_CHUNK_MIN;
+  if (n < 2)
+    return 0;
+
+  for (i = 0; i < n; i++) {
+    end = i == n - 1 ? size : size / n * (i + 1);
+    if (end < start)
+      end = start;
+    // chunk must not end inside token
+    while (end < size && cls[(unsigned char)buf[end]] == CH_IP)
+      end++;
+
+    jobs[i].buf = buf + start;
+    jobs[i].size = end - start;
+    jobs[i].skip = ctx->skip;
+    start = end;
+  }
+
+  parse_run(parse_job_run, jobs, sizeof(jobs[0]), n);
+
+  for (step = 1; step < n; step *= 2) {
+    for (i = 0, m = 0; i + step < n; i += 2 * step, m++) {
+      merges[m].a = &jobs[i].set;
+      merges[m].b = &jobs[i + step].set;
+    }
+    parse_run(parse_merge_run, merges, sizeof(merges[0]), m);
+  }
+
+  iap_set_free(ctx->set);
+  *ctx->set = jobs[0].set;
+  ctx->normalized = 1;
+  return 1;
+}
+
+/**
+ * Parse file mapped into memory. Falls back to block reads for files which
+ * can not be mapped (pipes, character devices).
+ */
+static void parse_file(struct parse_ctx *ctx, const char *path) {
+  struct stat st;
+  size_t tail = 0;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    parse_fail(ctx, "failed to open file '@%s': %s", path, strerror(errno));
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (map = mmap((void *)0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) !=
+          MAP_FAILED) {
+    close(fd);
+#ifdef MADV_SEQUENTIAL
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+    // binary records are read in one pass, large text file parsed into empty
+    // set is split between threads
+    if (parse_format != IAP_FORMAT_TEXT)
+      tail = parse_records(ctx, map, st.st_size);
+    else if (!ctx->set || ctx->set->n || ctx->set->map ||
+             !parse_parallel(ctx, map, st.st_size))
+      parse_buffer(ctx, map, st.st_size, 1);
+    munmap(map, st.st_size);
+
+    if (tail)
+      parse_fail(ctx, "truncated record at end of file '@%s'", path);
+    return;
+  }
+
+  parse_stream(ctx, fd);
+  close(fd);
+}
+
+/**
+ * Load compiled set. Set is used without copy if nothing was parsed before.
+ */
+static void parse_compiled(struct parse_ctx *ctx, const char *path) {
+  char buffer[IAP_BEST_LEN + 1];
+  iap_set_t c = {0};
+  const char *err;
+  size_t i;
+  int len;
+
+  iap_stats_phase("load");
+  if (!iapb_load(path, &c, &err))
+    parse_fail(ctx, "failed to load compiled set '@@%s': %s", path, err);
+
+  if (ctx->set && !ctx->set->v) {
+    *ctx->set = c;
+    return;
+  }
+
+  for (i = 0; i < c.n; i++) {
+    len = iap_pfx_ntoa(&c.v[i], buffer);
+    parse_pfx(ctx, &c.v[i], buffer, len);
+  }
+
+  iap_set_free(&c);
+}
+
+static void parse_input(int argc, char **argv, struct parse_ctx *ctx) {
+  int i;
+
+  if (argc == 0)
+    return;
+
+  chclass_init();
+
+  if (argc == 1) {
+    if (strncmp(argv[0], "@@", 2) == 0 && strlen(argv[0]) > 2) {
+      // compiled set
+      parse_compiled(ctx, argv[0] + 2);
+    } else if (argv[0][0] == '@' && strlen(argv[0]) > 1) {
       // file
-      in = fopen(argv[0] + 1, "r");
-      if (!in)
-        parse_fail(root, "failed to open file '%s': %s", buffer,
-                   strerror(errno));
+      parse_file(ctx, argv[0] + 1);
     } else if (strcmp(argv[0], "-") == 0) {
       // stdin
-      ;
-    } else if (iap_aton(argv[0], strlen(argv[0]), NULL) > 0 ||
-               iap_range_aton(argv[0], strlen(argv[0]), NULL, NULL) > 0) {
-      parse_token(root, buffer);
-      return;
+      parse_stream(ctx, STDIN_FILENO);
     } else {
-      parse_fail(root, "failed to parse input: %s\n", buffer);
-    }
-    c = fgetc(in);
-    while (c != EOF) {
-      if (strchr(ipchars, c)) {
-        if (buffer_p - buffer >= sizeof(buffer) - 1)
-          parse_fail(root, "failed to parse input: %s", buffer);
-        *buffer_p++ = c;
-        *buffer_p = '\0';
-      } else if (strchr(delimiters, c)) {
-        parse_token(root, buffer);
-        buffer_p = buffer;
-      } else {
-        parse_fail(root, "invalid character: %c", c);
-      }
-      c = fgetc(in);
-    }
-    if (in != stdin) {
-      fclose(in);
+      IAP_STAT_ADD(tokens, 1);
+      parse_token(ctx, argv[0], strlen(argv[0]));
     }
   } else {
     for (i = 0; i < argc; i++) {
-      strncpy(buffer, argv[i], sizeof(buffer) - 1);
-      buffer[sizeof(buffer) - 1] = '\0';
       // ip range
-      parse_token(root, buffer);
+      IAP_STAT_ADD(tokens, 1);
+      parse_token(ctx, argv[i], strlen(argv[i]));
+    }
+  }
+}
+
+void parse_ips(int argc, char **argv, iap_t **root) {
+  struct parse_ctx ctx = {root, (void *)0, (void *)0, (void *)0, 0};
+  iap_stats_phase("insert");
+  parse_input(argc, argv, &ctx);
+}
+
+size_t shard_set(const iap_set_t *set, size_t **bounds) {
+  size_t threads = cmd_threads(), size;
+
+  *bounds = (void *)0;
+  size = set->n / (threads * SHARD_PER_THREAD);
+  if (size < SHARD_MIN)
+    size = SHARD_MIN;
+  if (size > SHARD_MAX)
+    size = SHARD_MAX;
+  if (threads < 2 || set->n < 2 * size)
+    return 0;
+
+  *bounds = malloc((set->n / size + 258) * sizeof(size_t));
+  if (!*bounds) {
+    fprintf(stderr, "Error: failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return iap_set_shards(set, size, *bounds);
+}
+
+/**
+ * Shards of one batch, every shard is formatted into own memory sink
+ */
+struct print_batch {
+  print_proc_p proc;
+  void *data;
+  size_t first;
+  iap_out_t *outs;
+};
+
+static void print_batch_run(size_t task, void *arg) {
+  struct print_batch *b = arg;
+
+  b->proc(b->first + task, &b->outs[task], b->data);
+}
+
+void print_shards(size_t n, print_proc_p proc, void *data) {
+  int threads = cmd_threads();
+  size_t batch = threads * PRINT_SHARDS_PER_THREAD, c, i;
+  struct print_batch b = {proc, data};
+  iap_out_t o;
+
+  if (batch > n)
+    batch = n;
+  b.outs = calloc(batch, sizeof(iap_out_t));
+  if (!b.outs || !iap_out_open(&o, STDOUT_FILENO, print_format)) {
+    fprintf(stderr, "Error: failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < batch; i++)
+    if (!iap_out_open(&b.outs[i], -1, print_format)) {
+      fprintf(stderr, "Error: failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+
+  // output of batch is written in order of shards before next batch starts,
+  // so text held in memory is bounded by size of shard times batch. Buffers
+  // of shards are reused by next batch.
+  for (b.first = 0; b.first < n; b.first += c) {
+    c = n - b.first < batch ? n - b.first : batch;
+    iap_work_run(c, threads, print_batch_run, &b);
+
+    for (i = 0; i < c; i++) {
+      iap_out_put(&o, b.outs[i].bufs[0], b.outs[i].p - b.outs[i].bufs[0]);
+      b.outs[i].p = b.outs[i].bufs[0];
     }
   }
+
+  for (i = 0; i < batch; i++)
+    iap_out_close(&b.outs[i]);
+  iap_out_close(&o);
+  free(b.outs);
+}
+
+/**
+ * Set printed by shards
+ */
+struct print_set_ctx {
+  const iap_set_t *set;
+  const size_t *bounds;
+};
+
+static void print_set_shard(size_t shard, iap_out_t *o, void *data) {
+  struct print_set_ctx *ctx = data;
+  iap_set_t part = {0};
+
+  part.v = ctx->set->v + ctx->bounds[shard];
+  part.n = ctx->bounds[shard + 1] - ctx->bounds[shard];
+  iap_out_set(o, &part);
+}
+
+void print_set(const iap_set_t *set) {
+  struct print_set_ctx ctx = {set};
+  size_t *bounds, n;
+  iap_out_t o;
+
+  iap_stats_phase("output");
+
+  // large set is formatted by several threads
+  if ((n = shard_set(set, &bounds))) {
+    ctx.bounds = bounds;
+    print_shards(n, print_set_shard, &ctx);
+    free(bounds);
+    return;
+  }
+
+  if (!iap_out_open(&o, STDOUT_FILENO, print_format)) {
+    fprintf(stderr, "Error: failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  iap_out_set(&o, set);
+  iap_out_close(&o);
+}
+
+void parse_ips_stream(int argc, char **argv, parse_proc_p proc, void *data,
+                      int flags) {
+  struct parse_ctx ctx = {(void *)0, (void *)0, proc, data,
+                          (flags & PARSE_SKIP_INVALID) != 0};
+  iap_stats_phase("stream");
+  parse_input(argc, argv, &ctx);
+}
+
+void parse_ips_set(int argc, char **argv, iap_set_t *set) {
+  struct parse_ctx ctx = {(void *)0, set, (void *)0, (void *)0, 0};
+  iap_stats_phase("parse");
+  parse_input(argc, argv, &ctx);
+
+  // compiled set is already normalized
+  iap_stats_phase("normalize");
+  if (!set->map && !ctx.normalized && !iap_set_normalize(set))
+    parse_fail(&ctx, "failed to allocate memory");
+}
+
+void parse_ips_bulk(int argc, char **argv, iap_t **root) {
+  iap_set_t set = {0};
+  struct parse_ctx ctx = {(void *)0, &set, (void *)0, (void *)0, 0};
+
+  parse_ips_set(argc, argv, &set);
+
+  iap_stats_phase("build");
+  if (!iap_set_tree(&set, root))
+    parse_fail(&ctx, "failed to allocate memory");
+
+  iap_set_free(&set);
 }
@@ -0,0 +1,53 @@
+#include "arg.h"
+#include "cmd.h"
+#include "core.h"
+#include "iap.h"
+#include "iapb.h"
+#include "lpm.h"
+#include "set.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int cmd_compile(int argc, char **argv) {
+  arg_opt_t opts[] = {{"output", 1, NULL, 'o'}, {"index", 0}, {NULL}};
+  iap_set_t set = {0};
+  iap_lpm_t lpm = {0};
+  int n, ok;
+
+  n = arg_parse(argc, argv, opts);
+  argc -= n;
+  argv += n;
+
+  if (!opts[0].value)
+    FAILURE("Error: output file is required.\n\n" SHORT_USAGE);
+
+  parse_ips_set(argc, argv, &set);
+
+  iap_stats_phase("index");
+  if (opts[1].value && !iap_lpm_build(&lpm, &set))
+    FAILURE("Error: failed to allocate memory\n");
+
+  iap_stats_phase("write");
+  // small set gets frozen index which is not stored
+  ok = iapb_write(opts[0].value, &set, lpm.tbl24 ? &lpm : NULL);
+  if (!ok)
+    FAILURE("Error: failed to write '%s': %s\n", opts[0].value,
+            strerror(errno));
+
+  iap_lpm_free(&lpm);
+  iap_set_free(&set);
+  return 0;
+}
+
+void cmd_compile_help() {
+  printf("Usage: iap compile [--index] -o <file> <input>\n\n"
+         "Write normalized list of subnets into binary file. Every command\n"
+         "loads such file given as @@file without parsing.\n\n"
+         "  -o, --output FILE  output file\n"
+         "  --index            also store lookup table (64MiB and more) used\n"
+         "                     by lookup and filter, ignored for small sets\n");
+}
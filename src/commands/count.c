@@ -0,0 +1,83 @@
+#include "arg.h"
+#include "cmd.h"
+#include "core.h"
+#include "iap.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
+#include "work.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Set counted by shards, every shard has own statistics
+ */
+struct count_ctx {
+  const iap_set_t *set;
+  const size_t *bounds;
+  iap_count_t *parts;
+};
+
+static void count_shard(size_t shard, void *data) {
+  struct count_ctx *ctx = data;
+
+  iap_set_count_part(ctx->set, ctx->bounds[shard], ctx->bounds[shard + 1],
+                     &ctx->parts[shard]);
+}
+
+int cmd_count(int argc, char **argv) {
+  iap_set_t set = {0};
+  struct count_ctx ctx = {&set};
+  size_t *bounds, n, k;
+  iap_count_t c;
+  int i;
+
+  if (print_format != IAP_FORMAT_TEXT)
+    FAILURE("Error: count has text output only\n");
+
+  parse_ips_set(argc, argv, &set);
+  iap_stats_phase("aggregate");
+  iap_set_aggregate(&set);
+  iap_stats_phase("count");
+
+  if ((n = shard_set(&set, &bounds))) {
+    ctx.bounds = bounds;
+    ctx.parts = malloc(n * sizeof(iap_count_t));
+    if (!ctx.parts)
+      FAILURE("Error: failed to allocate memory\n");
+
+    iap_work_run(n, cmd_threads(), count_shard, &ctx);
+
+    memset(&c, 0, sizeof(c));
+    for (k = 0; k < n; k++)
+      iap_count_add(&c, &ctx.parts[k]);
+    free(ctx.parts);
+    free(bounds);
+  } else
+    iap_set_count(&set, &c);
+
+  iap_stats_phase("output");
+  printf("addresses\t%llu\nprefixes\t%zu\nranges\t%zu\n", c.addresses,
+         c.prefixes, c.ranges);
+  for (i = 0; i <= 32; i++)
+    if (c.lengths[i])
+      printf("length\t/%d\t%zu\n", i, c.lengths[i]);
+  for (i = 0; i < 256; i++)
+    if (c.blocks[i])
+      printf("block\t%d.0.0.0/8\t%llu\t%.2f%%\n", i, c.blocks[i],
+             c.blocks[i] * 100.0 / (1 << 24));
+
+  iap_set_free(&set);
+  return 0;
+}
+
+void cmd_count_help() {
+  printf("Usage: iap count <input>\n\n"
+         "Print count of covered addresses, prefixes of minimal list of\n"
+         "subnets (same as deflate), ranges of adjacent subnets, count of\n"
+         "subnets of every prefix length (\"length\") and covered addresses\n"
+         "of every /8 (\"block\"). Addresses are not expanded, time depends\n"
+         "on count of subnets only.\n");
+}
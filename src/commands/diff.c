@@ -1,10 +1,80 @@
 #include "cmd.h"
 #include "arg.h"
 #include "core.h"
+#include "iap.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void print_pfx(iap_out_t *o, char sign, const iap_pfx_t *p) {
+  char *s = iap_out_reserve(o, IAP_OUT_LINE_MAX);
+
+  *s++ = sign;
+  s = iap_fmt_pfx(s, p->net, p->cidr);
+  *s++ = '\n';
+  o->p = s;
+}
 
 int cmd_diff(int argc, char **argv) {
-    // Implementation of the deflate command
-    return 0;
+  arg_opt_t opts[] = {{"symmetric", 0}, {NULL}};
+  iap_set_t old = {0}, new = {0}, removed = {0}, added = {0};
+  iap_out_t o;
+  size_t i = 0, j = 0;
+  int n;
+
+  n = arg_parse(argc, argv, opts);
+  argc -= n;
+  argv += n;
+
+  if (argc != 2)
+    FAILURE("Error: two lists of subnets are required.\n\n" SHORT_USAGE);
+  // there is no place for sign in binary records
+  if (print_format != IAP_FORMAT_TEXT && !opts[0].value)
+    FAILURE("Error: binary output of diff requires --symmetric\n");
+
+  parse_ips_set(1, argv, &old);
+  parse_ips_set(1, argv + 1, &new);
+  iap_stats_phase("diff");
+
+  if (opts[0].value) {
+    if (!iap_set_diff(&old, &new, &removed, &removed))
+      FAILURE("Error: failed to allocate memory\n");
+    print_set(&removed);
+  } else {
+    if (!iap_set_diff(&old, &new, &removed, &added))
+      FAILURE("Error: failed to allocate memory\n");
+
+    iap_stats_phase("output");
+    if (!iap_out_open(&o, STDOUT_FILENO, print_format))
+      FAILURE("Error: failed to allocate memory\n");
+
+    // both lists are sorted and disjoint, print them in address order
+    while (i < removed.n || j < added.n) {
+      if (j == added.n ||
+          (i < removed.n && removed.v[i].net < added.v[j].net))
+        print_pfx(&o, '-', &removed.v[i++]);
+      else
+        print_pfx(&o, '+', &added.v[j++]);
+    }
+
+    iap_out_close(&o);
+  }
+
+  iap_set_free(&added);
+  iap_set_free(&removed);
+  iap_set_free(&new);
+  iap_set_free(&old);
+  return 0;
 }
 
-void cmd_diff_help() {}
+void cmd_diff_help() {
+  printf("Usage: iap diff [--symmetric] <old> <new>\n\n"
+         "Print subnets removed from old list (\"-\") and added in new list\n"
+         "(\"+\").\n\n"
+         "  --symmetric  print subnets which are in one list only, without "
+         "sign\n");
+}
@@ -1,10 +1,77 @@
-#include "cmd.h"
 #include "arg.h"
+#include "cmd.h"
 #include "core.h"
+#include "iap.h"
+#include "lpm.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct filter_ctx {
+  iap_lpm_t lpm;
+  iap_out_t out;
+  int invert;
+};
+
+static void filter_proc(const char *str, int len, unsigned int from,
+                        unsigned int to, void *data) {
+  struct filter_ctx *ctx = (struct filter_ctx *)data;
+
+  if (iap_lpm_covers(&ctx->lpm, from, to) == ctx->invert)
+    return;
+
+  // binary input has no text, binary output has no token text
+  if (str && ctx->out.format == IAP_FORMAT_TEXT) {
+    iap_out_write(&ctx->out, str, len);
+    iap_out_write(&ctx->out, "\n", 1);
+  } else
+    iap_out_range(&ctx->out, from, to);
+}
 
 int cmd_filter(int argc, char **argv) {
-    // Implementation of the deflate command
-    return 0;
+  arg_opt_t opts[] = {{"invert-match", 0}, {NULL}};
+  struct filter_ctx ctx = {0};
+  iap_set_t set = {0};
+  char *stdin_argv[] = {"-"};
+  int n, i;
+
+  n = arg_parse(argc, argv, opts);
+  ctx.invert = opts[0].value != NULL;
+  argc -= n;
+  argv += n;
+
+  if (argc < 1)
+    FAILURE("Error: list of subnets is required.\n\n" SHORT_USAGE);
+
+  parse_ips_set(1, argv, &set);
+  iap_stats_phase("index");
+  if (!iap_lpm_build(&ctx.lpm, &set))
+    FAILURE("Error: failed to allocate memory\n");
+
+  if (!iap_out_open(&ctx.out, STDOUT_FILENO, print_format))
+    FAILURE("Error: failed to allocate memory\n");
+
+  // every input is streamed separately: file, stdin or single token
+  for (i = 1; i < argc; i++)
+    parse_ips_stream(1, argv + i, filter_proc, &ctx, PARSE_SKIP_INVALID);
+  if (argc == 1)
+    parse_ips_stream(1, stdin_argv, filter_proc, &ctx, PARSE_SKIP_INVALID);
+
+  iap_out_close(&ctx.out);
+  iap_lpm_free(&ctx.lpm);
+  iap_set_free(&set);
+  return 0;
 }
 
-void cmd_filter_help() {}
+void cmd_filter_help() {
+  printf("Usage: iap filter [--invert-match] <subnets> [inputs...]\n\n"
+         "Print addresses from inputs which are inside list of subnets.\n"
+         "Inputs are files (@file), stdin (-) or addresses, stdin is read\n"
+         "if no input given. Text which is not address is skipped, so\n"
+         "addresses can be picked from logs.\n\n"
+         "  --invert-match  print addresses outside of list of subnets\n");
+}
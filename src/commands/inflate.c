@@ -1,31 +1,194 @@
+#include "arg.h"
 #include "cmd.h"
 #include "core.h"
+#include "iap.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-void walk(const iap_t *a, int depth, int mode, void *data) {
-  if (mode != IAP_WALK_INORDER)
-    return;
+// addresses written by one shard
+#define INFLATE_SHARD (1ULL << 15)
 
-  iap_t from = {0}, to = {0};
-  iap_from(a, &from);
-  iap_to(a, &to);
-  char buffer[IAP_BEST_LEN + 1] = {0};
+/**
+ * Text of last octet with newline
+ */
+struct octet {
+  char s[4];
+  int len;
+};
 
-  while (iap_raw(&from) <= iap_raw(&to)) {
-    iap_ntoa((const iap_t *)&from, buffer);
-    printf("%s\n", buffer);
-    iap_inc(&from);
+static struct octet octets[256];
+
+static void octets_init(void) {
+  int i;
+
+  for (i = 0; i < 256; i++) {
+    octets[i].len = iap_fmt_u8(octets[i].s, i) - octets[i].s;
+    octets[i].s[octets[i].len++] = '\n';
+  }
+}
+
+/**
+ * Write all addresses from "from" to "to" inclusive. First three octets are
+ * formatted once per /24 block, then only last octet text is appended.
+ */
+static void inflate_range(iap_out_t *o, unsigned int from, unsigned int to) {
+  unsigned long long a = from, end = (unsigned long long)to + 1, block_end;
+  char head[16] = {0}, *p;
+  int hlen;
+
+  while (a < end) {
+    p = iap_fmt_u8(head, (a >> 24) & 0xff);
+    *p++ = '.';
+    p = iap_fmt_u8(p, (a >> 16) & 0xff);
+    *p++ = '.';
+    p = iap_fmt_u8(p, (a >> 8) & 0xff);
+    *p++ = '.';
+    hlen = p - head;
+
+    block_end = ((a >> 8) + 1) << 8;
+    if (block_end > end)
+      block_end = end;
+
+    for (; a < block_end; a++) {
+      const struct octet *t = &octets[a & 0xff];
+
+      p = iap_out_reserve(o, IAP_OUT_LINE_MAX);
+      memcpy(p, head, sizeof(head));
+      memcpy(p + hlen, t->s, sizeof(t->s));
+      o->p = p + hlen + t->len;
+    }
+  }
+}
+
+/**
+ * Write all addresses from "from" to "to" inclusive as binary records. Every
+ * run of records which fits into buffer is written without checks.
+ */
+static void inflate_range_bin(iap_out_t *o, unsigned int from,
+                              unsigned int to) {
+  unsigned long long a = from, end = (unsigned long long)to + 1, n;
+  int bin = o->format == IAP_FORMAT_BIN;
+  char *p;
+
+  while (a < end) {
+    p = iap_out_reserve(o, IAP_FORMAT_BIN_SIZE);
+    n = (o->end - p) / IAP_FORMAT_BIN_SIZE;
+    if (n > end - a)
+      n = end - a;
+
+    for (; n; n--, a++) {
+      p = iap_put_be32(p, (unsigned int)a);
+      if (bin)
+        *p++ = 32;
+    }
+    o->p = p;
+  }
+}
+
+/**
+ * Write "limit" addresses starting from address of rank "offset". Set must
+ * have prefix sums if offset is not 0.
+ */
+static void inflate_part(iap_out_t *o, const iap_set_t *set,
+                         unsigned long long offset, unsigned long long limit) {
+  unsigned int from, to;
+  size_t i = 0;
+
+  // first prefix is found by rank of offset, not by scan of prefixes
+  if (offset) {
+    i = iap_set_select(set, offset);
+    if (i < set->n)
+      offset -= set->sums[i];
+  }
+
+  for (; i < set->n && limit; i++) {
+    from = set->v[i].net + (unsigned int)offset;
+    to = iap_pfx_last(&set->v[i]);
+    offset = 0;
+
+    if (limit <= to - from)
+      to = from + (limit - 1);
+    limit -= (unsigned long long)(to - from) + 1;
+
+    if (o->format == IAP_FORMAT_TEXT)
+      inflate_range(o, from, to);
+    else
+      inflate_range_bin(o, from, to);
   }
 }
 
+/**
+ * Addresses split into shards of equal count
+ */
+struct inflate_ctx {
+  const iap_set_t *set;
+  unsigned long long offset, limit;
+};
+
+static void inflate_shard(size_t shard, iap_out_t *o, void *data) {
+  struct inflate_ctx *ctx = data;
+  unsigned long long first = (unsigned long long)shard * INFLATE_SHARD;
+  unsigned long long n = ctx->limit - first;
+
+  inflate_part(o, ctx->set, ctx->offset + first,
+               n < INFLATE_SHARD ? n : INFLATE_SHARD);
+}
+
 int cmd_inflate(int argc, char **argv) {
-  // Implementation of the deflate command
-  iap_t *root = (void *)0;
-  parse_ips(argc, argv, &root);
-  iap_walk(root, walk, (void *)0);
-  iap_free(&root);
+  arg_opt_t opts[] = {{"offset", 1}, {"limit", 1}, {NULL}};
+  iap_set_t set = {0};
+  struct inflate_ctx ctx = {&set};
+  unsigned long long offset, limit, total;
+  iap_out_t o;
+  int n;
+
+  n = arg_parse(argc, argv, opts);
+  offset = arg_ull(&opts[0], 0);
+  limit = arg_ull(&opts[1], ~0ULL);
+
+  parse_ips_set(argc - n, argv + n, &set);
+
+  iap_stats_phase("output");
+  octets_init();
+  if (!iap_set_sums(&set))
+    FAILURE("Error: failed to allocate memory\n");
+
+  total = set.sums[set.n];
+  if (offset > total)
+    offset = total;
+  if (limit > total - offset)
+    limit = total - offset;
+
+  // shards are ranges of address ranks found by iap_set_select, so every
+  // shard has the same count of addresses
+  if (cmd_threads() > 1 && limit >= 2 * INFLATE_SHARD) {
+    ctx.offset = offset;
+    ctx.limit = limit;
+    print_shards((limit + INFLATE_SHARD - 1) / INFLATE_SHARD, inflate_shard,
+                 &ctx);
+    iap_set_free(&set);
+    return 0;
+  }
+
+  if (!iap_out_open(&o, STDOUT_FILENO, print_format))
+    FAILURE("Error: failed to allocate memory\n");
+
+  inflate_part(&o, &set, offset, limit);
+
+  iap_out_close(&o);
+  iap_set_free(&set);
   return 0;
 }
 
-void cmd_inflate_help() {}
+void cmd_inflate_help() {
+  printf("Usage: iap inflate [--offset N] [--limit N] <input>\n\n"
+         "Expand subnets into list of addresses.\n\n"
+         "  --offset N  skip first N addresses, found in O(log n)\n"
+         "  --limit N   print at most N addresses\n");
+}
@@ -1,10 +1,62 @@
 #include "cmd.h"
 #include "arg.h"
 #include "core.h"
+#include "iap.h"
+#include "set.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Set inverted by shards
+ */
+struct invert_ctx {
+  const iap_set_t *set;
+  const size_t *bounds;
+};
+
+static void invert_shard(size_t shard, iap_out_t *o, void *data) {
+  struct invert_ctx *ctx = data;
+  iap_set_t out = {0};
+
+  if (!iap_set_invert_part(ctx->set, ctx->bounds[shard],
+                           ctx->bounds[shard + 1], &out))
+    FAILURE("Error: failed to allocate memory\n");
+
+  iap_out_set(o, &out);
+  iap_set_free(&out);
+}
 
 int cmd_invert(int argc, char **argv) {
-    // Implementation of the deflate command
+  iap_set_t set = {0}, out = {0};
+  struct invert_ctx ctx = {&set};
+  size_t *bounds, n;
+
+  parse_ips_set(argc, argv, &set);
+  iap_stats_phase("invert");
+
+  // every shard inverts and prints gaps before its prefixes
+  if ((n = shard_set(&set, &bounds))) {
+    ctx.bounds = bounds;
+    print_shards(n, invert_shard, &ctx);
+    free(bounds);
+    iap_set_free(&set);
     return 0;
+  }
+
+  if (!iap_set_invert(&set, &out))
+    FAILURE("Error: failed to allocate memory\n");
+
+  print_set(&out);
+
+  iap_set_free(&out);
+  iap_set_free(&set);
+  return 0;
 }
 
-void cmd_invert_help() {}
+void cmd_invert_help() {
+  printf("Usage: iap invert <input>\n\n"
+         "Print minimal list of subnets covering all addresses which are not\n"
+         "in input.\n");
+}
@@ -1,10 +1,110 @@
-#include "cmd.h"
 #include "arg.h"
+#include "cmd.h"
 #include "core.h"
+#include "iap.h"
+#include "lpm.h"
+#include "out.h"
+#include "set.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct lookup_ctx {
+  iap_lpm_t lpm;
+  iap_out_t out;
+  int flags;
+};
+
+static void lookup_proc(const char *str, int len, unsigned int from,
+                        unsigned int to, void *data) {
+  struct lookup_ctx *ctx = (struct lookup_ctx *)data;
+  long i = iap_lpm_find(&ctx->lpm, from);
+  char *s;
+
+  // token must be inside single prefix
+  if (i >= 0 && to > iap_pfx_last(&ctx->lpm.set->v[i]))
+    i = -1;
+
+  // binary flag is raw byte 1 or 0
+  if (ctx->flags) {
+    s = iap_out_reserve(&ctx->out, 2);
+    if (ctx->out.format == IAP_FORMAT_TEXT) {
+      *s++ = i >= 0 ? '1' : '0';
+      *s++ = '\n';
+    } else
+      *s++ = i >= 0;
+    ctx->out.p = s;
+    return;
+  }
+
+  // binary output is record of matching subnet only
+  if (ctx->out.format != IAP_FORMAT_TEXT) {
+    s = iap_out_reserve(&ctx->out, IAP_FORMAT_BIN_SIZE);
+    s = iap_put_be32(s, i >= 0 ? ctx->lpm.set->v[i].net : 0);
+    *s++ = i >= 0 ? ctx->lpm.set->v[i].cidr : IAP_CIDR_INVALID;
+    ctx->out.p = s;
+    return;
+  }
+
+  if (str)
+    iap_out_write(&ctx->out, str, len);
+  s = iap_out_reserve(&ctx->out, IAP_OUT_LINE_MAX);
+  // binary input has no text, every record is single prefix
+  if (!str)
+    s = iap_fmt_pfx(s, from, 32 - __builtin_popcount(to - from));
+  *s++ = '\t';
+  if (i >= 0)
+    s = iap_fmt_pfx(s, ctx->lpm.set->v[i].net, ctx->lpm.set->v[i].cidr);
+  else
+    *s++ = '-';
+  *s++ = '\n';
+  ctx->out.p = s;
+}
 
 int cmd_lookup(int argc, char **argv) {
-    // Implementation of the deflate command
-    return 0;
+  arg_opt_t opts[] = {{"flags", 0}, {NULL}};
+  struct lookup_ctx ctx = {0};
+  iap_set_t set = {0};
+  char *stdin_argv[] = {"-"};
+  int n;
+
+  n = arg_parse(argc, argv, opts);
+  ctx.flags = opts[0].value != NULL;
+  argc -= n;
+  argv += n;
+
+  if (argc < 1)
+    FAILURE("Error: list of subnets is required.\n\n" SHORT_USAGE);
+  if (print_format == IAP_FORMAT_BIN32 && !ctx.flags)
+    FAILURE("Error: lookup writes subnets, use bin output format\n");
+
+  parse_ips_set(1, argv, &set);
+  iap_stats_phase("index");
+  if (!iap_lpm_build(&ctx.lpm, &set))
+    FAILURE("Error: failed to allocate memory\n");
+
+  if (!iap_out_open(&ctx.out, STDOUT_FILENO, print_format))
+    FAILURE("Error: failed to allocate memory\n");
+
+  if (argc > 1)
+    parse_ips_stream(argc - 1, argv + 1, lookup_proc, &ctx, 0);
+  else
+    parse_ips_stream(1, stdin_argv, lookup_proc, &ctx, 0);
+
+  iap_out_close(&ctx.out);
+  iap_lpm_free(&ctx.lpm);
+  iap_set_free(&set);
+  return 0;
 }
 
-void cmd_lookup_help() {}
+void cmd_lookup_help() {
+  printf("Usage: iap lookup [--flags] <subnets> [addresses...]\n\n"
+         "Find subnet containing every address. Addresses are read from\n"
+         "stdin if not given. Every address is printed with matching subnet\n"
+         "or \"-\". Binary output holds matching subnet only, prefix length\n"
+         "255 if there is no match.\n\n"
+         "  --flags  print only 1 (match) or 0 (no match) for every address,\n"
+         "           byte 0x01 or 0x00 in binary output\n");
+}
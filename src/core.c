@@ -1,4 +1,8 @@
 #include "core.h"
+#include "out.h"
+#include "pool.h"
+#include "set.h"
+#include "stats.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -16,8 +20,8 @@ static inline unsigned int iap_mask_fast(int cidr) {
  * return ip address as unsigned integer
  */
 static inline unsigned int iap_raw_fast(const iap_t *addr) {
-  return (addr->a[0] << 24) | (addr->a[1] << 16) | (addr->a[2] << 8) |
-         addr->a[3];
+  return ((unsigned int)addr->a[0] << 24) | (addr->a[1] << 16) |
+         (addr->a[2] << 8) | addr->a[3];
 }
 
 /**
@@ -29,6 +33,26 @@ static inline int iap_in_fast(const iap_t *net, const iap_t *addr) {
              (iap_raw_fast(addr) & iap_mask_fast(net->cidr));
 }
 
+static inline void iap_from_fast(const iap_t *net, iap_t *out) {
+  unsigned int raw_a = iap_raw_fast(net) & iap_mask_fast(net->cidr);
+  out->a[0] = (raw_a >> 24) & 0xff;
+  out->a[1] = (raw_a >> 16) & 0xff;
+  out->a[2] = (raw_a >> 8) & 0xff;
+  out->a[3] = raw_a & 0xff;
+  out->cidr = 32;
+}
+
+static inline void iap_to_fast(const iap_t *net, iap_t *out) {
+  unsigned int raw_a = iap_raw_fast(net) | ~iap_mask_fast(net->cidr);
+  out->a[0] = (raw_a >> 24) & 0xff;
+  out->a[1] = (raw_a >> 16) & 0xff;
+  out->a[2] = (raw_a >> 8) & 0xff;
+  out->a[3] = raw_a & 0xff;
+  out->cidr = 32;
+}
+
+#ifndef IAP_TRIE
+
 static inline int max(int a, int b) { return a > b ? a : b; }
 
 /**
@@ -36,6 +60,21 @@ static inline int max(int a, int b) { return a > b ? a : b; }
  */
 static inline int height(iap_t *node) { return node ? node->avl_height : 0; }
 
+/**
+ * Return count of nodes in subtree
+ */
+static inline unsigned int count(iap_t *node) {
+  return node ? node->avl_count : 0;
+}
+
+/**
+ * Recalculate AVL height and subtree nodes count from children
+ */
+static inline void fix(iap_t *node) {
+  node->avl_height = max(height(node->l), height(node->r)) + 1;
+  node->avl_count = count(node->l) + count(node->r) + 1;
+}
+
 /**
  * Return AVL balance factor for target node
  */
@@ -54,8 +93,9 @@ static inline iap_t *rotl(iap_t *x) {
   y->l = x;
   x->r = T2;
 
-  x->avl_height = max(height(x->l), height(x->r)) + 1;
-  y->avl_height = max(height(y->l), height(y->r)) + 1;
+  fix(x);
+  fix(y);
+  IAP_STAT_ADD(rotations, 1);
 
   return y;
 }
@@ -71,8 +111,9 @@ static inline iap_t *rotr(iap_t *y) {
   x->r = y;
   y->l = T2;
 
-  y->avl_height = max(height(y->l), height(y->r)) + 1;
-  x->avl_height = max(height(x->l), height(x->r)) + 1;
+  fix(y);
+  fix(x);
+  IAP_STAT_ADD(rotations, 1);
 
   return x;
 }
@@ -87,6 +128,7 @@ static iap_t *balance(iap_t *node) {
   if (!node)
     return NULL;
 
+  fix(node);
   bfac = bfactor(node);
 
   if (bfac > 1) {
@@ -145,6 +187,47 @@ static inline int iap_key_cmp_strict_fast(const iap_t *a, const iap_t *b) {
   return 0;
 }
 
+/**
+ * remove leftmost node of subtree
+ */
+static iap_t *iap_remove_min_fast(iap_t *root) {
+  iap_t *r;
+
+  if (!root->l) {
+    r = root->r;
+    iap_node_release(root);
+    return r;
+  }
+
+  root->l = iap_remove_min_fast(root->l);
+  return balance(root);
+}
+
+/**
+ * unlink subtree root node. Node is replaced by its successor.
+ */
+static iap_t *iap_unlink_fast(iap_t *root) {
+  iap_t *t;
+
+  IAP_STAT_ADD(removed, 1);
+
+  if (!root->l || !root->r) {
+    t = root->l ? root->l : root->r;
+    iap_node_release(root);
+    return t;
+  }
+
+  t = root->r;
+  while (t->l)
+    t = t->l;
+
+  memmove(root->a, t->a, sizeof(root->a));
+  root->cidr = t->cidr;
+  root->r = iap_remove_min_fast(root->r);
+
+  return root;
+}
+
 /**
  * remove node from tree by address and cidr.
  */
@@ -155,72 +238,131 @@ static iap_t *iap_remove_fast(iap_t *root, const iap_t *addr) {
     return (void *)0;
 
   cmp = iap_key_cmp_strict_fast(root, addr);
-  if (cmp > 0)
+  if (cmp < 0)
     root->r = iap_remove_fast(root->r, addr);
-  else if (cmp < 0)
+  else if (cmp > 0)
     root->l = iap_remove_fast(root->l, addr);
-  else {
-    iap_t *t = root;
-
-    if (!root->l)
-      root = root->r;
-    else if (!root->r)
-      root = root->l;
-    else {
-      iap_t *p = root->r;
+  else
+    root = iap_unlink_fast(root);
 
-      while (p->l)
-        p = p->l;
+  return balance(root);
+}
 
-      memmove(root, p, sizeof(iap_t));
+/**
+ * return all nodes of subtree into pool
+ */
+static void iap_release_fast(iap_t *root) {
+  iap_t *t;
 
-      root->r = iap_remove_fast(root->r, p);
-      t = (void *)0;
+  // flatten tree by right rotations and release nodes from the left end
+  while (root) {
+    if (root->l) {
+      t = root->l;
+      root->l = t->r;
+      t->r = root;
+      root = t;
+    } else {
+      t = root->r;
+      iap_node_release(root);
+      root = t;
     }
+  }
+}
 
-    free(t);
+/**
+ * join two trees with node "k", all keys of "l" are less than key of "k" and
+ * all keys of "r" are greater. Cost is difference of heights.
+ */
+static iap_t *iap_join_fast(iap_t *l, iap_t *k, iap_t *r) {
+  if (height(l) > height(r) + 1) {
+    l->r = iap_join_fast(l->r, k, r);
+    return balance(l);
   }
 
-  return balance(root);
+  if (height(r) > height(l) + 1) {
+    r->l = iap_join_fast(l, k, r->l);
+    return balance(r);
+  }
+
+  k->l = l;
+  k->r = r;
+  fix(k);
+  return k;
 }
 
 /**
- * remove all nodes contain in target subnet
+ * detach leftmost node of subtree into "min"
  */
-static iap_t *iap_prune_fast(iap_t *root, const iap_t *net) {
-  iap_t *t;
+static iap_t *iap_take_min_fast(iap_t *root, iap_t **min) {
+  if (!root->l) {
+    *min = root;
+    return root->r;
+  }
 
-  if (!root)
-    return (void *)0;
+  root->l = iap_take_min_fast(root->l, min);
+  return balance(root);
+}
 
-  if (root->l)
-    root->l = iap_prune_fast(root->l, net);
-  if (root->r)
-    root->r = iap_prune_fast(root->r, net);
+/**
+ * join two trees, all keys of "l" are less than keys of "r"
+ */
+static iap_t *iap_join2_fast(iap_t *l, iap_t *r) {
+  iap_t *k;
 
-  if (iap_in_fast(net, root)) {
-    t = root;
+  if (!l || !r)
+    return l ? l : r;
 
-    if (!root->l)
-      root = root->r;
-    else if (!root->r)
-      root = root->l;
-    else {
-      iap_t *p = root->r;
+  r = iap_take_min_fast(r, &k);
+  return iap_join_fast(l, k, r);
+}
 
-      while (p->l)
-        p = p->l;
+/**
+ * split tree into nodes with address less than "raw" and the rest in
+ * O(log n)
+ */
+static void iap_split_fast(iap_t *root, unsigned int raw, iap_t **l,
+                           iap_t **r) {
+  iap_t *m;
 
-      memmove(root, p, sizeof(iap_t));
+  if (!root) {
+    *l = *r = (void *)0;
+    return;
+  }
 
-      root->r = iap_remove_fast(root->r, p);
-      t = (void *)0;
-    }
+  if (iap_raw_fast(root) < raw) {
+    iap_split_fast(root->r, raw, &m, r);
+    *l = iap_join_fast(root->l, root, m);
+  } else {
+    iap_split_fast(root->l, raw, l, &m);
+    *r = iap_join_fast(m, root, root->r);
+  }
+}
 
-    free(t);
+/**
+ * remove all nodes contain in target subnet. Members are disjoint, so nodes
+ * inside subnet are contiguous key range: it is cut out by two splits and
+ * released at once, rest is joined back. O(log n + k).
+ */
+static iap_t *iap_prune_fast(iap_t *root, const iap_t *net) {
+  unsigned int lo = iap_raw_fast(net) & iap_mask_fast(net->cidr),
+               hi = lo | ~iap_mask_fast(net->cidr);
+  iap_t *l, *m, *r;
+
+  iap_split_fast(root, lo, &l, &m);
+  r = (void *)0;
+  if (hi != ~0U)
+    iap_split_fast(m, hi + 1, &m, &r);
+
+  // supernet of "net" starting at the same address is the only node of
+  // range, it stays
+  if (m && !iap_in_fast(net, m)) {
+    r = iap_join2_fast(m, r);
+  } else if (m) {
+    IAP_STAT_ADD(removed, m->avl_count);
+    iap_release_fast(m);
   }
 
-  return balance(root);
+  return iap_join2_fast(l, r);
 }
 
 /**
@@ -261,6 +403,7 @@ _again:
     assert(infloop_guard == 0);
     infloop_guard = 1;
 
+    IAP_STAT_ADD(prunes, 1);
     *root = iap_prune_fast(*root, new);
     goto _again;
   }
@@ -268,17 +411,20 @@ _again:
   // p now is &(parent_node->[left|right])
 
   iap_t *t;
-  t = malloc(sizeof(iap_t));
+  t = iap_node_alloc();
 
   if (!t)
     goto _emem;
 
-  memmove(t, new, sizeof(iap_t));
+  memmove(t->a, new->a, sizeof(t->a));
+  t->cidr = new->cidr;
   t->avl_height = 1;
+  t->avl_count = 1;
   t->l = 0;
   t->r = 0;
 
   *p = t;
+  IAP_STAT_ADD(inserted, 1);
 
   // balance tree postorder
   int i;
@@ -291,50 +437,60 @@ _emem:
   exit(EXIT_FAILURE);
 }
 
-static inline void iap_from_fast(const iap_t *net, iap_t *out) {
-  unsigned int raw_a = iap_raw_fast(net) & iap_mask_fast(net->cidr);
-  out->a[0] = (raw_a >> 24) & 0xff;
-  out->a[1] = (raw_a >> 16) & 0xff;
-  out->a[2] = (raw_a >> 8) & 0xff;
-  out->a[3] = raw_a & 0xff;
-  out->cidr = 32;
-}
+/**
+ * return all nodes of tree into pool. If tree holds every live node of pool,
+ * whole chunks are unmapped without visiting nodes.
+ */
+static void iap_free_fast(iap_t *root) {
+  if (root && root->avl_count == iap_pool.live) {
+    iap_pool_reset();
+    return;
+  }
 
-static inline void iap_to_fast(const iap_t *net, iap_t *out) {
-  unsigned int raw_a = iap_raw_fast(net) | ~iap_mask_fast(net->cidr);
-  out->a[0] = (raw_a >> 24) & 0xff;
-  out->a[1] = (raw_a >> 16) & 0xff;
-  out->a[2] = (raw_a >> 8) & 0xff;
-  out->a[3] = raw_a & 0xff;
-  out->cidr = 32;
+  iap_release_fast(root);
 }
 
 /**
- * free tree
+ * build balanced subtree from sorted prefixes
  */
-static void iap_free_fast(iap_t *root) {
-  if (!root)
-    return;
+static iap_t *iap_build_fast(const iap_pfx_t *v, size_t n) {
+  iap_t *t;
+  size_t mid;
 
-  if (root->l)
-    iap_free_fast(root->l);
-  if (root->r)
-    iap_free_fast(root->r);
+  if (!n)
+    return (void *)0;
 
-  free(root);
-}
+  mid = n / 2;
+  t = iap_node_alloc();
+  if (!t)
+    return (void *)0;
 
-unsigned int iap_raw(const iap_t *addr) { return iap_raw_fast(addr); }
+  t->a[0] = (v[mid].net >> 24) & 0xff;
+  t->a[1] = (v[mid].net >> 16) & 0xff;
+  t->a[2] = (v[mid].net >> 8) & 0xff;
+  t->a[3] = v[mid].net & 0xff;
+  t->cidr = v[mid].cidr;
+  t->l = iap_build_fast(v, mid);
+  t->r = iap_build_fast(v + mid + 1, n - mid - 1);
 
-unsigned int iap_mask(int cidr) { return iap_mask_fast(cidr); }
+  if ((mid && !t->l) || (n - mid - 1 && !t->r))
+    return (void *)0;
 
-int iap_in(const iap_t *net, const iap_t *a) { return iap_in_fast(net, a); }
+  fix(t);
+  return t;
+}
+
+int iap_set_tree(const iap_set_t *set, iap_t **root) {
+  *root = iap_build_fast(set->v, set->n);
+  return set->n == 0 || *root != (void *)0;
+}
 
 void iap_remove(iap_t **root, const iap_t *a) {
   *root = iap_remove_fast(*root, a);
 }
 
 void iap_prune(iap_t **root, const iap_t *net) {
+  IAP_STAT_ADD(prunes, 1);
   *root = iap_prune_fast(*root, net);
 }
 
@@ -343,6 +499,14 @@ void iap_free(iap_t **root) {
   *root = (void *)0;
 }
 
+#endif
+
+unsigned int iap_raw(const iap_t *addr) { return iap_raw_fast(addr); }
+
+unsigned int iap_mask(int cidr) { return iap_mask_fast(cidr); }
+
+int iap_in(const iap_t *net, const iap_t *a) { return iap_in_fast(net, a); }
+
 void iap_inc(iap_t *net) {
   unsigned int raw_a = iap_raw_fast(net) + 1;
   net->a[0] = (raw_a >> 24) & 0xff;
@@ -355,56 +519,8 @@ void iap_from(const iap_t *net, iap_t *from) { iap_from_fast(net, from); }
 
 void iap_to(const iap_t *net, iap_t *to) { iap_to_fast(net, to); }
 
-static char *u8tab[] = {
-    "0",   "1",   "2",   "3",   "4",   "5",   "6",   "7",   "8",   "9",   "10",
-    "11",  "12",  "13",  "14",  "15",  "16",  "17",  "18",  "19",  "20",  "21",
-    "22",  "23",  "24",  "25",  "26",  "27",  "28",  "29",  "30",  "31",  "32",
-    "33",  "34",  "35",  "36",  "37",  "38",  "39",  "40",  "41",  "42",  "43",
-    "44",  "45",  "46",  "47",  "48",  "49",  "50",  "51",  "52",  "53",  "54",
-    "55",  "56",  "57",  "58",  "59",  "60",  "61",  "62",  "63",  "64",  "65",
-    "66",  "67",  "68",  "69",  "70",  "71",  "72",  "73",  "74",  "75",  "76",
-    "77",  "78",  "79",  "80",  "81",  "82",  "83",  "84",  "85",  "86",  "87",
-    "88",  "89",  "90",  "91",  "92",  "93",  "94",  "95",  "96",  "97",  "98",
-    "99",  "100", "101", "102", "103", "104", "105", "106", "107", "108", "109",
-    "110", "111", "112", "113", "114", "115", "116", "117", "118", "119", "120",
-    "121", "122", "123", "124", "125", "126", "127", "128", "129", "130", "131",
-    "132", "133", "134", "135", "136", "137", "138", "139", "140", "141", "142",
-    "143", "144", "145", "146", "147", "148", "149", "150", "151", "152", "153",
-    "154", "155", "156", "157", "158", "159", "160", "161", "162", "163", "164",
-    "165", "166", "167", "168", "169", "170", "171", "172", "173", "174", "175",
-    "176", "177", "178", "179", "180", "181", "182", "183", "184", "185", "186",
-    "187", "188", "189", "190", "191", "192", "193", "194", "195", "196", "197",
-    "198", "199", "200", "201", "202", "203", "204", "205", "206", "207", "208",
-    "209", "210", "211", "212", "213", "214", "215", "216", "217", "218", "219",
-    "220", "221", "222", "223", "224", "225", "226", "227", "228", "229", "230",
-    "231", "232", "233", "234", "235", "236", "237", "238", "239", "240", "241",
-    "242", "243", "244", "245", "246", "247", "248", "249", "250", "251", "252",
-    "253", "254", "255"};
-
-static inline int u8toa(unsigned char v, char *out) {
-  const char *s = u8tab[v];
-  int i = 0;
-
-  while ((out[i] = s[i]))
-    i++;
-
-  return i;
-}
-
 static inline int iap_ntoa_fast(const iap_t *a, char *out) {
-  char *p = out;
-
-  // clang-format off
-  p += u8toa(a->a[0], p); *p = '.'; p++;
-  p += u8toa(a->a[1], p); *p = '.'; p++;
-  p += u8toa(a->a[2], p); *p = '.'; p++;
-  p += u8toa(a->a[3], p);
-
-  if(a->cidr != 32) {
-    *p = '/'; p++;
-    p += u8toa(a->cidr, p);
-  }
-  // clang-format on
+  char *p = iap_fmt_pfx(out, iap_raw_fast(a), a->cidr);
 
   *p = '\0';
 
@@ -446,11 +562,11 @@ int iap_aton(const char *str, int size, iap_t *out) {
   if (!digit || part != 3)
     return 0;
 
-  if (*p == '/') {
+  if (p - str < size && *p == '/') {
     p++;
     digit = 0;
     cidr = 0;
-    while (*p >= '0' && *p <= '9') {
+    while (p - str < size && *p >= '0' && *p <= '9') {
       cidr = cidr * 10 + (*p - '0');
 
       if (digit >= 2 || cidr > 32)
@@ -480,6 +596,8 @@ int iap_aton(const char *str, int size, iap_t *out) {
   return p - str;
 }
 
+#ifndef IAP_TRIE
+
 static void iap_walk_fast(const iap_t *root, int level, void *data,
                           iap_walk_proc_p proc) {
   if (!root)
@@ -502,6 +620,59 @@ void iap_walk(const iap_t *root, iap_walk_proc_p proc, void *data) {
   iap_walk_fast(root, 0, data, proc);
 }
 
+/**
+ * push node and whole chain of its left children
+ */
+static inline void iap_iter_push_fast(iap_iter_t *it, const iap_t *t) {
+  for (; t; t = t->l)
+    it->stack[it->sp++] = t;
+}
+
+static inline const iap_t *iap_iter_next_fast(iap_iter_t *it) {
+  const iap_t *t;
+
+  if (!it->sp)
+    return (void *)0;
+
+  t = it->stack[--it->sp];
+  iap_iter_push_fast(it, t->r);
+  return t;
+}
+
+void iap_iter_init(iap_iter_t *it, const iap_t *root) {
+  it->sp = 0;
+  iap_iter_push_fast(it, root);
+}
+
+void iap_iter_seek(iap_iter_t *it, const iap_t *root, unsigned int raw) {
+  iap_t to;
+
+  // members are disjoint, so they are ordered by last address too. Stack
+  // keeps nodes where search went left, they follow in order.
+  it->sp = 0;
+  while (root) {
+    iap_to_fast(root, &to);
+    if (iap_raw_fast(&to) >= raw) {
+      it->stack[it->sp++] = root;
+      root = root->l;
+    } else
+      root = root->r;
+  }
+}
+
+const iap_t *iap_iter_next(iap_iter_t *it) { return iap_iter_next_fast(it); }
+
+size_t iap_iter_next_n(iap_iter_t *it, const iap_t **out, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n && (out[i] = iap_iter_next_fast(it)); i++)
+    ;
+
+  return i;
+}
+
+#endif
+
 int iap_eq(const iap_t *net0, const iap_t *net1) {
   if (!net0 || !net1)
     return 0;
@@ -511,23 +682,68 @@ int iap_eq(const iap_t *net0, const iap_t *net1) {
           (iap_raw_fast(net1) & iap_mask(net1->cidr)));
 }
 
+int iap_range_split(unsigned int from, unsigned int to, iap_pfx_t *out) {
+  unsigned long long f = from, end = (unsigned long long)to + 1;
+  int bits, span, n = 0;
+
+  while (f < end) {
+    // largest block aligned on "f" which does not run over "end"
+    bits = f ? __builtin_ctzll(f) : 32;
+    span = 63 - __builtin_clzll(end - f);
+    if (span < bits)
+      bits = span;
+
+    out[n].net = (unsigned int)f;
+    out[n].cidr = 32 - bits;
+    n++;
+
+    f += 1ULL << bits;
+  }
+
+  return n;
+}
+
 int iap_range_insert(const iap_t *from, const iap_t *to, iap_t **root) {
-  return 0;
+  iap_pfx_t blocks[IAP_RANGE_MAX];
+  iap_t a = {0};
+  int i, n;
+
+  n = iap_range_split(iap_raw_fast(from), iap_raw_fast(to), blocks);
+
+  // blocks are disjoint, so none of them prunes previous ones
+  for (i = 0; i < n; i++) {
+    a.a[0] = (blocks[i].net >> 24) & 0xff;
+    a.a[1] = (blocks[i].net >> 16) & 0xff;
+    a.a[2] = (blocks[i].net >> 8) & 0xff;
+    a.a[3] = blocks[i].net & 0xff;
+    a.cidr = blocks[i].cidr;
+
+    if (!iap_insert(root, &a))
+      return 0;
+  }
+
+  return n;
 }
 
 int iap_range_aton(const char *str, int size, iap_t *from, iap_t *to) {
-  char *p = strchr(str, '-');
-  if (!p || p - str >= size)
+  iap_t f = {0}, t = {0};
+  const char *p = memchr(str, '-', size);
+  if (!p)
     return 0;
 
-  if (!iap_aton(str, p - str, from) || from->cidr != 32)
+  if (!iap_aton(str, p - str, &f) || f.cidr != 32)
     return 0;
 
-  if (!iap_aton(p + 1, size - (p - str + 1), to) || to->cidr != 32)
+  if (!iap_aton(p + 1, size - (p - str + 1), &t) || t.cidr != 32)
     return 0;
 
-  if (iap_raw_fast(from) > iap_raw_fast(to))
+  if (iap_raw_fast(&f) > iap_raw_fast(&t))
     return 0;
 
+  if (from)
+    *from = f;
+  if (to)
+    *to = t;
+
   return 1;
 }
@@ -0,0 +1,49 @@
+#include "frozen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// nodes "8k" - "8k + 7" share one cache line
+#define IAP_FROZEN_ALIGN 64
+
+/**
+ * fill subtree of slot "k" in order with prefixes starting from index "i",
+ * return index of next prefix
+ */
+static size_t frozen_fill(iap_frozen_t *f, const iap_set_t *set, size_t i,
+                          size_t k) {
+  if (k > f->n)
+    return i;
+
+  i = frozen_fill(f, set, i, 2 * k);
+  f->v[k] = set->v[i];
+  f->rank[k] = i;
+  return frozen_fill(f, set, i + 1, 2 * k + 1);
+}
+
+int iap_frozen_build(iap_frozen_t *f, const iap_set_t *set) {
+  size_t size = (set->n + 1) * sizeof(iap_pfx_t);
+
+  memset(f, 0, sizeof(iap_frozen_t));
+
+  size = (size + IAP_FROZEN_ALIGN - 1) / IAP_FROZEN_ALIGN * IAP_FROZEN_ALIGN;
+  f->v = aligned_alloc(IAP_FROZEN_ALIGN, size);
+  f->rank = malloc((set->n + 1) * sizeof(unsigned int));
+  if (!f->v || !f->rank) {
+    iap_frozen_free(f);
+    return 0;
+  }
+
+  f->n = set->n;
+  memset(&f->v[0], 0, sizeof(iap_pfx_t));
+  f->rank[0] = 0;
+  frozen_fill(f, set, 0, 1);
+
+  return 1;
+}
+
+void iap_frozen_free(iap_frozen_t *f) {
+  free(f->v);
+  free(f->rank);
+  memset(f, 0, sizeof(iap_frozen_t));
+}
@@ -1,9 +1,59 @@
 #include "iap.h"
 #include "cmd.h"
+#include "out.h"
+#include "stats.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Return IAP_FORMAT_* for value of "--in-format" or "--out-format" option,
+ * exit if format is unknown.
+ */
+static int format_option(const char *name) {
+  int format = iap_format_parse(name);
+
+  if (format < 0)
+    FAILURE("Error: unknown format '%s', use text, bin or bin32.\n", name);
+  return format;
+}
+
+/**
+ * Take global options "--stats[=FILE]", "--in-format=FORMAT" and
+ * "--out-format=FORMAT" out of arguments. Return path of report file, "" for
+ * stderr or NULL if stats are not requested.
+ */
+static const char *global_options(int *argc, char **argv) {
+  const char *path = (void *)0;
+  int i, n = 1;
+
+  for (i = 1; i < *argc; i++) {
+    if (strcmp(argv[i], "--") == 0) {
+      while (i < *argc)
+        argv[n++] = argv[i++];
+      break;
+    }
+
+    if (strcmp(argv[i], "--stats") == 0)
+      path = "";
+    else if (strncmp(argv[i], "--stats=", 8) == 0)
+      path = argv[i] + 8;
+    else if (strncmp(argv[i], "--in-format=", 12) == 0)
+      parse_format = format_option(argv[i] + 12);
+    else if (strncmp(argv[i], "--out-format=", 13) == 0)
+      print_format = format_option(argv[i] + 13);
+    else
+      argv[n++] = argv[i];
+  }
+
+  *argc = n;
+  return path;
+}
 
 int main(int argc, char **argv) {
+  const char *stats = global_options(&argc, argv);
+
   if (argc < 2) {
     fprintf(stderr, "Error: Invalid count of arguments.\n\n" SHORT_USAGE);
     return 1;
@@ -13,6 +63,9 @@ int main(int argc, char **argv) {
   int rc;
 
   if (cmd) {
+    if (stats && !iap_stats_start(cmd->name, *stats ? stats : NULL))
+      FAILURE("Error: iap is built without --stats support\n");
+
     if(argc == 2) {
       rc = cmd->proc(0, NULL);
     } else {
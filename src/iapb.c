@@ -0,0 +1,228 @@
+#include "iapb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IAPB_TBL24_SIZE ((size_t)1 << 24)
+
+/**
+ * Hash of data by 8-byte words. "size" must be multiple of 8.
+ */
+static unsigned long long iapb_hash(unsigned long long h, const void *data,
+                                    size_t size) {
+  const unsigned char *p = data;
+  unsigned long long w;
+  size_t i;
+
+  for (i = 0; i < size; i += 8) {
+    memcpy(&w, p + i, 8);
+    h ^= w;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+  }
+
+  return h;
+}
+
+/**
+ * Check prefixes are valid, sorted and disjoint as every set algorithm
+ * expects of normalized set.
+ */
+static int iapb_valid(const iap_pfx_t *v, size_t n) {
+  unsigned long long next = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (v[i].cidr > 32 || (v[i].net & ~iap_mask(v[i].cidr)) ||
+        v[i].net < next)
+      return 0;
+    next = (unsigned long long)iap_pfx_last(&v[i]) + 1;
+  }
+
+  return 1;
+}
+
+/**
+ * Check entries of lookup table point into set and into second level.
+ */
+static int iapb_valid_index(const struct iap_map *map) {
+  const struct iapb_header *hdr = map->header;
+  size_t i, n = hdr->groups * 256;
+  unsigned int e;
+
+  for (i = 0; i < IAPB_TBL24_SIZE; i++) {
+    e = map->tbl24[i];
+    if (e & IAP_LPM_EXT ? (e & ~IAP_LPM_EXT) >= hdr->groups : e > hdr->count)
+      return 0;
+  }
+
+  for (i = 0; i < n; i++)
+    if (map->tbl8[i] > hdr->count)
+      return 0;
+
+  return 1;
+}
+
+static int iapb_fwrite(FILE *f, const void *data, size_t size,
+                       unsigned long long *h) {
+  if (h)
+    *h = iapb_hash(*h, data, size);
+  return fwrite(data, 1, size, f) == size;
+}
+
+int iapb_write(const char *path, const iap_set_t *set, const iap_lpm_t *lpm) {
+  struct iapb_header hdr = {0};
+  unsigned long long h = 0, hi = 0;
+  FILE *f;
+  int ok, err;
+
+  memcpy(hdr.magic, IAPB_MAGIC, sizeof(IAPB_MAGIC));
+  hdr.version = IAPB_VERSION;
+  hdr.byte_order = IAPB_BYTE_ORDER;
+  hdr.flags = lpm ? IAPB_F_INDEX : 0;
+  hdr.count = set->n;
+  hdr.groups = lpm ? lpm->groups : 0;
+
+  f = fopen(path, "wb");
+  if (!f)
+    return 0;
+
+  // header is written again when checksums of payload are known
+  ok = iapb_fwrite(f, &hdr, sizeof(hdr), (void *)0) &&
+       iapb_fwrite(f, set->v, set->n * sizeof(iap_pfx_t), &h);
+  if (lpm)
+    ok = ok &&
+         iapb_fwrite(f, lpm->tbl24, IAPB_TBL24_SIZE * sizeof(int), &hi) &&
+         iapb_fwrite(f, lpm->tbl8, lpm->groups * 256 * sizeof(int), &hi);
+
+  hdr.checksum = h;
+  hdr.index_checksum = hi;
+  ok = ok && fseek(f, 0, SEEK_SET) == 0 &&
+       iapb_fwrite(f, &hdr, sizeof(hdr), (void *)0);
+
+  err = errno;
+  if (fclose(f) != 0)
+    ok = 0;
+  else
+    errno = err;
+
+  return ok;
+}
+
+int iapb_load(const char *path, iap_set_t *set, const char **err) {
+  const struct iapb_header *hdr;
+  struct iap_map *map;
+  unsigned long long expect, h;
+  struct stat st;
+  void *addr;
+  int fd;
+
+  *err = (void *)0;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    *err = strerror(errno);
+    return 0;
+  }
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*hdr)) {
+    close(fd);
+    *err = "not a compiled set";
+    return 0;
+  }
+
+  addr = mmap((void *)0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+              0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    *err = strerror(errno);
+    return 0;
+  }
+
+  hdr = addr;
+  if (memcmp(hdr->magic, IAPB_MAGIC, sizeof(IAPB_MAGIC)) != 0)
+    *err = "not a compiled set";
+  else if (hdr->byte_order != IAPB_BYTE_ORDER)
+    *err = "compiled on machine with different byte order";
+  else if (hdr->version != IAPB_VERSION)
+    *err = "unsupported version";
+
+  // counts are bounded by file size first, so sizes below do not overflow
+  if (!*err && (hdr->count > (size_t)st.st_size / sizeof(iap_pfx_t) ||
+                hdr->groups > (size_t)st.st_size / (256 * sizeof(int))))
+    *err = "truncated file";
+
+  if (!*err) {
+    expect = sizeof(*hdr) + hdr->count * sizeof(iap_pfx_t);
+    if (hdr->flags & IAPB_F_INDEX)
+      expect += (IAPB_TBL24_SIZE + hdr->groups * 256) * sizeof(int);
+
+    if (expect != (unsigned long long)st.st_size)
+      *err = "truncated file";
+  }
+
+  // lookup table is verified by iapb_check_index() when it is used
+  if (!*err) {
+    h = iapb_hash(0, (const char *)addr + sizeof(*hdr),
+                  hdr->count * sizeof(iap_pfx_t));
+    if (h != hdr->checksum)
+      *err = "checksum mismatch";
+  }
+
+  if (!*err &&
+      !iapb_valid((const iap_pfx_t *)((const char *)addr + sizeof(*hdr)),
+                  hdr->count))
+    *err = "prefixes are not valid, sorted and disjoint";
+
+  map = *err ? (void *)0 : malloc(sizeof(struct iap_map));
+  if (!*err && !map)
+    *err = "failed to allocate memory";
+
+  if (*err) {
+    munmap(addr, st.st_size);
+    return 0;
+  }
+
+  map->addr = addr;
+  map->size = st.st_size;
+  map->header = hdr;
+  map->tbl24 = (void *)0;
+  map->tbl8 = (void *)0;
+  map->index_state = 0;
+  if (hdr->flags & IAPB_F_INDEX) {
+    map->tbl24 = (unsigned int *)((char *)addr + sizeof(*hdr) +
+                                  hdr->count * sizeof(iap_pfx_t));
+    map->tbl8 = map->tbl24 + IAPB_TBL24_SIZE;
+  }
+
+  set->v = (iap_pfx_t *)((char *)addr + sizeof(*hdr));
+  set->n = set->cap = hdr->count;
+  set->map = map;
+
+  return 1;
+}
+
+int iapb_check_index(struct iap_map *map) {
+  const struct iapb_header *hdr = map->header;
+  unsigned long long h;
+
+  if (!map->index_state) {
+    h = iapb_hash(0, map->tbl24,
+                  (IAPB_TBL24_SIZE + hdr->groups * 256) * sizeof(int));
+    map->index_state =
+        h == hdr->index_checksum && iapb_valid_index(map) ? 1 : -1;
+  }
+
+  return map->index_state > 0;
+}
+
+void iapb_close(struct iap_map *map) {
+  munmap(map->addr, map->size);
+  free(map);
+}
@@ -0,0 +1,108 @@
+#include "lpm.h"
+#include "iapb.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IAP_LPM_TBL24_SIZE (1U << 24)
+
+/**
+ * return second level group for /24 block, allocate new one if needed
+ */
+static unsigned int *lpm_group(iap_lpm_t *lpm, unsigned int block) {
+  unsigned int e = lpm->tbl24[block];
+
+  if (e & IAP_LPM_EXT)
+    return &lpm->tbl8[(size_t)(e & ~IAP_LPM_EXT) << 8];
+
+  if (lpm->groups == lpm->cap) {
+    size_t cap = lpm->cap ? lpm->cap * 2 : 64;
+    unsigned int *t = realloc(lpm->tbl8, cap * 256 * sizeof(unsigned int));
+
+    if (!t)
+      return (void *)0;
+
+    lpm->tbl8 = t;
+    lpm->cap = cap;
+  }
+
+  // normalized set has no prefix covering block which holds longer prefixes
+  memset(&lpm->tbl8[lpm->groups << 8], 0, 256 * sizeof(unsigned int));
+  lpm->tbl24[block] = IAP_LPM_EXT | lpm->groups;
+
+  return &lpm->tbl8[lpm->groups++ << 8];
+}
+
+int iap_lpm_build(iap_lpm_t *lpm, const iap_set_t *set) {
+  size_t i, j, cnt;
+  unsigned int *g;
+
+  memset(lpm, 0, sizeof(iap_lpm_t));
+  lpm->set = set;
+
+  // corrupted table of compiled file is rebuilt from verified prefixes
+  if (set->map && set->map->tbl24 && iapb_check_index(set->map)) {
+    lpm->tbl24 = set->map->tbl24;
+    lpm->tbl8 = set->map->tbl8;
+    lpm->groups = lpm->cap = set->map->header->groups;
+    lpm->mapped = 1;
+    return 1;
+  }
+
+  if (set->n <= IAP_LPM_FROZEN_MAX)
+    return iap_frozen_build(&lpm->frozen, set);
+
+  lpm->tbl24 = calloc(IAP_LPM_TBL24_SIZE, sizeof(unsigned int));
+  if (!lpm->tbl24)
+    return 0;
+
+  // prefixes are disjoint, so every entry is written at most once
+  for (i = 0; i < set->n; i++) {
+    const iap_pfx_t *p = &set->v[i];
+
+    if (p->cidr <= 24) {
+      cnt = (size_t)1 << (24 - p->cidr);
+      for (j = 0; j < cnt; j++)
+        lpm->tbl24[(p->net >> 8) + j] = i + 1;
+    } else {
+      g = lpm_group(lpm, p->net >> 8);
+      if (!g) {
+        iap_lpm_free(lpm);
+        return 0;
+      }
+
+      cnt = (size_t)1 << (32 - p->cidr);
+      for (j = 0; j < cnt; j++)
+        g[(p->net & 0xff) + j] = i + 1;
+    }
+  }
+
+  return 1;
+}
+
+void iap_lpm_free(iap_lpm_t *lpm) {
+  iap_frozen_free(&lpm->frozen);
+  if (!lpm->mapped) {
+    free(lpm->tbl24);
+    free(lpm->tbl8);
+  }
+  memset(lpm, 0, sizeof(iap_lpm_t));
+}
+
+int iap_lpm_covers(const iap_lpm_t *lpm, unsigned int from, unsigned int to) {
+  long i = iap_lpm_find(lpm, from);
+  unsigned int last;
+
+  if (i < 0)
+    return 0;
+
+  last = iap_pfx_last(&lpm->set->v[i]);
+  while (last < to) {
+    // next prefix must start right after previous one
+    if ((size_t)++i == lpm->set->n || lpm->set->v[i].net != last + 1)
+      return 0;
+    last = iap_pfx_last(&lpm->set->v[i]);
+  }
+
+  return 1;
+}
@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+#include "out.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define IAP_OUT_BUFFER_SIZE (1UL << 20)
+// first buffer of memory sink
+#define IAP_OUT_MEMORY_SIZE (64UL << 10)
+
+// clang-format off
+const char iap_digits2[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+// clang-format on
+
+static void out_fail(void) {
+  fprintf(stderr, "Error: failed to write output: %s\n", strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * write all buffers, partial writes are continued
+ */
+static void out_writev(int fd, struct iovec *iov, int n) {
+  ssize_t w;
+
+  while (n > 0) {
+    w = writev(fd, iov, n);
+    if (w < 0) {
+      if (errno == EINTR)
+        continue;
+      out_fail();
+    }
+
+    for (; n > 0 && (size_t)w >= iov->iov_len; iov++, n--)
+      w -= iov->iov_len;
+    if (n > 0) {
+      iov->iov_base = (char *)iov->iov_base + w;
+      iov->iov_len -= w;
+    }
+  }
+}
+
+int iap_format_parse(const char *name) {
+  if (strcmp(name, "text") == 0)
+    return IAP_FORMAT_TEXT;
+  if (strcmp(name, "bin") == 0)
+    return IAP_FORMAT_BIN;
+  if (strcmp(name, "bin32") == 0)
+    return IAP_FORMAT_BIN32;
+  return -1;
+}
+
+int iap_out_open(iap_out_t *o, int fd, int format) {
+  struct stat st;
+  int i;
+
+  memset(o, 0, sizeof(iap_out_t));
+  o->fd = fd;
+  o->format = format;
+  o->size = IAP_OUT_BUFFER_SIZE;
+
+  if (fd < 0) {
+    o->size = IAP_OUT_MEMORY_SIZE;
+    o->bufs[0] = malloc(o->size);
+    if (!o->bufs[0])
+      return 0;
+    o->p = o->bufs[0];
+    o->end = o->p + o->size;
+    return 1;
+  }
+
+#ifdef F_SETPIPE_SZ
+  // larger pipe takes whole buffer with one write, reader wakes up less often
+  if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+    fcntl(fd, F_SETPIPE_SZ, (int)IAP_OUT_BUFFER_SIZE);
+#else
+  (void)st;
+#endif
+
+  for (i = 0; i < IAP_OUT_BUFS; i++) {
+    o->bufs[i] = mmap((void *)0, o->size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (o->bufs[i] == MAP_FAILED) {
+      o->bufs[i] = (void *)0;
+      iap_out_close(o);
+      return 0;
+    }
+  }
+
+  o->p = o->bufs[0];
+  o->end = o->p + o->size;
+  return 1;
+}
+
+/**
+ * grow buffer of memory sink twice
+ */
+static void out_grow(iap_out_t *o) {
+  size_t used = o->p - o->bufs[0];
+  char *buf = realloc(o->bufs[0], o->size * 2);
+
+  if (!buf) {
+    fprintf(stderr, "Error: failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  o->size *= 2;
+  o->bufs[0] = buf;
+  o->p = buf + used;
+  o->end = buf + o->size;
+}
+
+void iap_out_next(iap_out_t *o) {
+  if (o->fd < 0) {
+    out_grow(o);
+    return;
+  }
+
+  if (o->cur + 1 < IAP_OUT_BUFS) {
+    // filled buffer waits, all buffers are written with one writev()
+    o->used[o->cur] = o->p - o->bufs[o->cur];
+    o->cur++;
+  } else {
+    iap_out_flush(o);
+    return;
+  }
+
+  o->p = o->bufs[o->cur];
+  o->end = o->p + o->size;
+}
+
+void iap_out_flush(iap_out_t *o) {
+  struct iovec iov[IAP_OUT_BUFS];
+  int i;
+
+  if (!o->p || o->fd < 0)
+    return;
+
+  for (i = 0; i < o->cur; i++) {
+    iov[i].iov_base = o->bufs[i];
+    iov[i].iov_len = o->used[i];
+  }
+  iov[i].iov_base = o->bufs[i];
+  iov[i].iov_len = o->p - o->bufs[i];
+
+  out_writev(o->fd, iov, i + 1);
+
+  o->cur = 0;
+  o->p = o->bufs[0];
+  o->end = o->p + o->size;
+}
+
+void iap_out_put(iap_out_t *o, const char *buf, size_t n) {
+  struct iovec iov = {(void *)buf, n};
+
+  // small text is cheaper to copy than to write separately
+  if (o->fd < 0 || n < o->size / 4) {
+    iap_out_write(o, buf, n);
+    return;
+  }
+
+  iap_out_flush(o);
+  out_writev(o->fd, &iov, 1);
+}
+
+void iap_out_close(iap_out_t *o) {
+  int i;
+
+  iap_out_flush(o);
+
+  if (o->fd < 0) {
+    free(o->bufs[0]);
+    memset(o, 0, sizeof(iap_out_t));
+    return;
+  }
+
+  for (i = 0; i < IAP_OUT_BUFS; i++)
+    if (o->bufs[i])
+      munmap(o->bufs[i], o->size);
+
+  memset(o, 0, sizeof(iap_out_t));
+}
+
+void iap_out_bad_pfx(const iap_pfx_t *p) {
+  char buffer[IAP_BEST_LEN + 1];
+
+  iap_pfx_ntoa(p, buffer);
+  fprintf(stderr,
+          "Error: subnet %s can not be written in bin32 format, use bin\n",
+          buffer);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * write records of set in runs which fit into current buffer
+ */
+static void out_set_bin(iap_out_t *o, const iap_set_t *set) {
+  size_t i = 0, n;
+  char *p;
+
+  while (i < set->n) {
+    n = (o->end - o->p) / IAP_FORMAT_BIN_SIZE;
+    if (!n) {
+      iap_out_next(o);
+      continue;
+    }
+    if (n > set->n - i)
+      n = set->n - i;
+
+    for (p = o->p; n; n--, i++) {
+      if (o->format == IAP_FORMAT_BIN32) {
+        if (set->v[i].cidr != 32)
+          iap_out_bad_pfx(&set->v[i]);
+        p = iap_put_be32(p, set->v[i].net);
+      } else {
+        p = iap_put_be32(p, set->v[i].net);
+        *p++ = set->v[i].cidr;
+      }
+    }
+    o->p = p;
+  }
+}
+
+void iap_out_set(iap_out_t *o, const iap_set_t *set) {
+  size_t i = 0, n;
+  char *p;
+
+  if (o->format != IAP_FORMAT_TEXT) {
+    out_set_bin(o, set);
+    return;
+  }
+
+  while (i < set->n) {
+    n = (o->end - o->p) / IAP_BEST_LEN;
+    if (!n) {
+      iap_out_next(o);
+      continue;
+    }
+    if (n > set->n - i)
+      n = set->n - i;
+
+    // every line fits, no checks inside run
+    for (p = o->p; n; n--, i++) {
+      p = iap_fmt_pfx(p, set->v[i].net, set->v[i].cidr);
+      *p++ = '\n';
+    }
+    o->p = p;
+  }
+}
@@ -0,0 +1,44 @@
+#include "pool.h"
+
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+struct iap_pool iap_pool;
+
+struct iap_chunk *iap_chunk_alloc(void) {
+  void *p = MAP_FAILED;
+
+#if defined(IAP_HUGEPAGES) && defined(MAP_HUGETLB)
+  p = mmap((void *)0, IAP_POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (p == MAP_FAILED) {
+    p = mmap((void *)0, IAP_POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      return (void *)0;
+#if defined(IAP_HUGEPAGES) && defined(MADV_HUGEPAGE)
+    madvise(p, IAP_POOL_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+  }
+
+  IAP_STAT_ADD(chunk_allocs, 1);
+  return (struct iap_chunk *)p;
+}
+
+void iap_pool_reset(void) {
+  struct iap_chunk *c = iap_pool.chunks, *t;
+
+  while (c) {
+    t = c->next;
+    munmap(c, IAP_POOL_CHUNK_SIZE);
+    c = t;
+  }
+
+  iap_pool.chunks = (void *)0;
+  iap_pool.freelist = (void *)0;
+  iap_pool.live = 0;
+}
@@ -0,0 +1,533 @@
+#include "set.h"
+#include "iapb.h"
+#include "out.h"
+#include "stats.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IAP_SET_MIN_CAP 1024
+#define IAP_SORT_PASSES 5
+// searches interleaved by iap_lookup_batch
+#define IAP_LOOKUP_GROUP 16
+
+/**
+ * drop prefix sums of changed set
+ */
+static inline void set_changed(iap_set_t *set) {
+  if (set->sums) {
+    free(set->sums);
+    set->sums = (void *)0;
+  }
+}
+
+/**
+ * grow array to hold at least "cap" prefixes
+ */
+static int set_reserve(iap_set_t *set, size_t cap) {
+  iap_pfx_t *v;
+
+  if (cap <= set->cap && !set->map)
+    return 1;
+
+  v = realloc(set->map ? (void *)0 : set->v, cap * sizeof(iap_pfx_t));
+  if (!v)
+    return 0;
+
+  // sets are filled by parse threads too
+  IAP_STAT_ADD_SHARED(set_allocs, 1);
+
+  if (set->map) {
+    memcpy(v, set->v, set->n * sizeof(iap_pfx_t));
+    iapb_close(set->map);
+    set->map = (void *)0;
+  }
+
+  set->v = v;
+  set->cap = cap;
+  return 1;
+}
+
+int iap_set_push(iap_set_t *set, unsigned int net, int cidr) {
+  set_changed(set);
+  if (set->n == set->cap &&
+      !set_reserve(set, set->cap ? set->cap * 2 : IAP_SET_MIN_CAP))
+    return 0;
+
+  set->v[set->n].net = net;
+  set->v[set->n].cidr = cidr;
+  set->n++;
+
+  return 1;
+}
+
+int iap_set_push_range(iap_set_t *set, unsigned int from, unsigned int to) {
+  iap_pfx_t blocks[IAP_RANGE_MAX];
+  int i, n;
+
+  n = iap_range_split(from, to, blocks);
+  for (i = 0; i < n; i++)
+    if (!iap_set_push(set, blocks[i].net, blocks[i].cidr))
+      return 0;
+
+  return n;
+}
+
+/**
+ * return byte of sort key for target pass. Pass 0 is prefix length, passes
+ * 1-4 are bytes of address starting from lowest.
+ */
+static inline unsigned int sort_digit(const iap_pfx_t *p, int pass) {
+  return pass ? (p->net >> ((pass - 1) * 8)) & 0xff : p->cidr;
+}
+
+int iap_set_sort(iap_set_t *set) {
+  size_t hist[IAP_SORT_PASSES][256];
+  iap_pfx_t *src = set->v, *dst, *t;
+  size_t i, sum, c;
+  int pass, d;
+
+  set_changed(set);
+  if (set->n < 2)
+    return 1;
+
+  dst = malloc(set->n * sizeof(iap_pfx_t));
+  if (!dst)
+    return 0;
+
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < set->n; i++)
+    for (pass = 0; pass < IAP_SORT_PASSES; pass++)
+      hist[pass][sort_digit(&src[i], pass)]++;
+
+  for (pass = 0; pass < IAP_SORT_PASSES; pass++) {
+    // all keys have same digit, pass would not move anything
+    if (hist[pass][sort_digit(&src[0], pass)] == set->n)
+      continue;
+
+    for (d = 0, sum = 0; d < 256; d++) {
+      c = hist[pass][d];
+      hist[pass][d] = sum;
+      sum += c;
+    }
+
+    for (i = 0; i < set->n; i++)
+      dst[hist[pass][sort_digit(&src[i], pass)]++] = src[i];
+
+    t = src;
+    src = dst;
+    dst = t;
+  }
+
+  if (src != set->v) {
+    memcpy(set->v, src, set->n * sizeof(iap_pfx_t));
+    dst = src;
+  }
+
+  free(dst);
+  return 1;
+}
+
+void iap_set_collapse(iap_set_t *set) {
+  size_t i, n = 0;
+  unsigned int last = 0;
+
+  set_changed(set);
+  for (i = 0; i < set->n; i++) {
+    // sorted prefixes are either nested or disjoint, so prefix starting
+    // inside previous one is part of it
+    if (n && set->v[i].net <= last)
+      continue;
+
+    set->v[n++] = set->v[i];
+    last = iap_pfx_last(&set->v[i]);
+
+    if (last == ~0U)
+      break;
+  }
+
+  IAP_STAT_ADD_SHARED(collapsed, set->n - n);
+  set->n = n;
+}
+
+int iap_set_normalize(iap_set_t *set) {
+  if (!iap_set_sort(set))
+    return 0;
+
+  iap_set_collapse(set);
+  return 1;
+}
+
+void iap_set_aggregate(iap_set_t *set) {
+  size_t i, n = 0;
+  iap_pfx_t *top;
+
+  set_changed(set);
+  for (i = 0; i < set->n; i++) {
+    set->v[n++] = set->v[i];
+
+    // merge top of stack with its left sibling while possible
+    while (n > 1) {
+      top = &set->v[n - 1];
+      if (!top->cidr || top[-1].cidr != top->cidr ||
+          (top[-1].net & iap_mask(top->cidr - 1)) != top[-1].net ||
+          top[-1].net + (1U << (32 - top->cidr)) != top->net)
+        break;
+
+      top[-1].cidr--;
+      n--;
+    }
+  }
+
+  IAP_STAT_ADD_SHARED(aggregated, set->n - n);
+  set->n = n;
+}
+
+int iap_set_merge(const iap_set_t *a, const iap_set_t *b, iap_set_t *out) {
+  unsigned long long next = 0;
+  const iap_pfx_t *p;
+  size_t i = 0, j = 0, n = out->n;
+
+  set_changed(out);
+  if (!set_reserve(out, out->n + a->n + b->n))
+    return 0;
+
+  while (i < a->n || j < b->n) {
+    if (j == b->n ||
+        (i < a->n && (a->v[i].net < b->v[j].net ||
+                      (a->v[i].net == b->v[j].net &&
+                       a->v[i].cidr <= b->v[j].cidr))))
+      p = &a->v[i++];
+    else
+      p = &b->v[j++];
+
+    // same as iap_set_collapse, prefix starting inside previous one is part
+    // of it
+    if (out->n && p->net < next)
+      continue;
+
+    out->v[out->n++] = *p;
+    next = (unsigned long long)iap_pfx_last(p) + 1;
+  }
+
+  IAP_STAT_ADD_SHARED(collapsed, a->n + b->n - (out->n - n));
+  return 1;
+}
+
+int iap_set_invert_part(const iap_set_t *set, size_t from, size_t to,
+                        iap_set_t *out) {
+  unsigned long long next;
+  size_t i;
+
+  next = from ? (unsigned long long)iap_pfx_last(&set->v[from - 1]) + 1 : 0;
+  for (i = from; i < to; i++) {
+    if (set->v[i].net > next &&
+        !iap_set_push_range(out, next, set->v[i].net - 1))
+      return 0;
+    next = (unsigned long long)iap_pfx_last(&set->v[i]) + 1;
+  }
+
+  if (to == set->n && next <= ~0U && !iap_set_push_range(out, next, ~0U))
+    return 0;
+
+  return 1;
+}
+
+int iap_set_invert(const iap_set_t *set, iap_set_t *out) {
+  return iap_set_invert_part(set, 0, set->n, out);
+}
+
+/**
+ * Range waiting for join with next adjacent one
+ */
+struct diff_pending {
+  iap_set_t *out;
+  unsigned long long from, to;
+  int active;
+};
+
+static int diff_flush(struct diff_pending *p) {
+  if (p->active && !iap_set_push_range(p->out, p->from, p->to))
+    return 0;
+  p->active = 0;
+  return 1;
+}
+
+static int diff_emit(struct diff_pending *p, unsigned long long from,
+                     unsigned long long to) {
+  if (p->active && p->to + 1 == from) {
+    p->to = to;
+    return 1;
+  }
+
+  if (!diff_flush(p))
+    return 0;
+
+  p->from = from;
+  p->to = to;
+  p->active = 1;
+  return 1;
+}
+
+int iap_set_diff(const iap_set_t *a, const iap_set_t *b, iap_set_t *only_a,
+                 iap_set_t *only_b) {
+  const unsigned long long end = 1ULL << 32;
+  struct diff_pending pa = {only_a}, pb = {only_b}, *pbp;
+  unsigned long long x = 0, na, nb, next;
+  size_t i = 0, j = 0;
+  int in_a, in_b;
+
+  pbp = only_a == only_b ? &pa : &pb;
+
+  while (x < end) {
+    while (i < a->n && iap_pfx_last(&a->v[i]) < x)
+      i++;
+    while (j < b->n && iap_pfx_last(&b->v[j]) < x)
+      j++;
+
+    // next point where membership of "x" may change in each set
+    in_a = i < a->n && a->v[i].net <= x;
+    in_b = j < b->n && b->v[j].net <= x;
+    na = i == a->n ? end
+         : in_a    ? (unsigned long long)iap_pfx_last(&a->v[i]) + 1
+                   : a->v[i].net;
+    nb = j == b->n ? end
+         : in_b    ? (unsigned long long)iap_pfx_last(&b->v[j]) + 1
+                   : b->v[j].net;
+    next = na < nb ? na : nb;
+
+    if (in_a && !in_b && !diff_emit(&pa, x, next - 1))
+      return 0;
+    if (in_b && !in_a && !diff_emit(pbp, x, next - 1))
+      return 0;
+
+    x = next;
+  }
+
+  return diff_flush(&pa) && diff_flush(&pb);
+}
+
+int iap_set_sums(iap_set_t *set) {
+  unsigned long long *sums;
+  size_t i;
+
+  if (set->sums)
+    return 1;
+
+  sums = malloc((set->n + 1) * sizeof(unsigned long long));
+  if (!sums)
+    return 0;
+
+  sums[0] = 0;
+  for (i = 0; i < set->n; i++)
+    sums[i + 1] = sums[i] + (1ULL << (32 - set->v[i].cidr));
+
+  set->sums = sums;
+  return 1;
+}
+
+size_t iap_set_select(const iap_set_t *set, unsigned long long k) {
+  const unsigned long long *base = set->sums;
+  size_t len = set->n, half;
+
+  assert(set->sums);
+  if (k >= set->sums[set->n])
+    return set->n;
+
+  // last prefix with count of addresses before it not greater than "k"
+  while (len > 1) {
+    half = len / 2;
+    base = base[half] <= k ? base + half : base;
+    len -= half;
+  }
+
+  return base - set->sums;
+}
+
+unsigned long long iap_rank(const iap_set_t *set, unsigned int addr) {
+  const iap_pfx_t *base = set->v;
+  size_t len = set->n, half, i;
+
+  assert(set->sums);
+  if (!set->n || set->v[0].net > addr)
+    return 0;
+
+  // last prefix starting at or before address
+  while (len > 1) {
+    half = len / 2;
+    base = base[half].net <= addr ? base + half : base;
+    len -= half;
+  }
+
+  i = base - set->v;
+  if (addr <= iap_pfx_last(base))
+    return set->sums[i] + (addr - base->net);
+  return set->sums[i + 1];
+}
+
+int iap_select(const iap_set_t *set, unsigned long long k,
+               unsigned int *addr) {
+  size_t i = iap_set_select(set, k);
+
+  if (i == set->n)
+    return 0;
+
+  *addr = set->v[i].net + (unsigned int)(k - set->sums[i]);
+  return 1;
+}
+
+void iap_set_count_part(const iap_set_t *set, size_t from, size_t to,
+                        iap_count_t *c) {
+  unsigned long long next, size;
+  const iap_pfx_t *p;
+  unsigned int b;
+  size_t i;
+
+  memset(c, 0, sizeof(iap_count_t));
+  c->prefixes = to - from;
+
+  // range continuing from previous part is counted there
+  next = from ? (unsigned long long)iap_pfx_last(&set->v[from - 1]) + 1 : 0;
+  for (i = from; i < to; i++) {
+    p = &set->v[i];
+    size = 1ULL << (32 - p->cidr);
+
+    c->addresses += size;
+    c->lengths[p->cidr]++;
+    if (!i || p->net != next)
+      c->ranges++;
+    next = (unsigned long long)p->net + size;
+
+    // prefix shorter than /8 covers several whole blocks
+    if (p->cidr >= 8)
+      c->blocks[p->net >> 24] += size;
+    else
+      for (b = p->net >> 24; b <= iap_pfx_last(p) >> 24; b++)
+        c->blocks[b] = 1ULL << 24;
+  }
+}
+
+void iap_set_count(const iap_set_t *set, iap_count_t *c) {
+  iap_set_count_part(set, 0, set->n, c);
+}
+
+void iap_count_add(iap_count_t *c, const iap_count_t *part) {
+  int i;
+
+  c->addresses += part->addresses;
+  c->prefixes += part->prefixes;
+  c->ranges += part->ranges;
+  for (i = 0; i <= 32; i++)
+    c->lengths[i] += part->lengths[i];
+  for (i = 0; i < 256; i++)
+    c->blocks[i] += part->blocks[i];
+}
+
+/**
+ * index of first prefix starting at or after address
+ */
+static size_t set_lower_bound(const iap_set_t *set, unsigned int addr) {
+  size_t lo = 0, hi = set->n, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (set->v[mid].net < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+size_t iap_set_shards(const iap_set_t *set, size_t size, size_t *bounds) {
+  size_t cur = 0, end, n = 0;
+  unsigned int b;
+
+  if (!size)
+    size = 1;
+
+  bounds[n++] = 0;
+  for (b = 1; b <= 256; b++) {
+    end = b < 256 ? set_lower_bound(set, b << 24) : set->n;
+
+    // heavy block is split, light blocks are joined with next ones
+    while (end - cur >= 2 * size) {
+      cur += size;
+      bounds[n++] = cur;
+    }
+    if (end - cur >= size || (b == 256 && end > cur)) {
+      cur = end;
+      bounds[n++] = cur;
+    }
+  }
+
+  return n - 1;
+}
+
+/**
+ * interleaved branchless binary search of "n" addresses (at most one group)
+ * for last prefix starting at or before address
+ */
+static size_t lookup_group(const iap_set_t *set, const unsigned int *addrs,
+                           size_t n, long *out) {
+  const iap_pfx_t *base[IAP_LOOKUP_GROUP];
+  size_t len = set->n, half, i, found = 0;
+
+  for (i = 0; i < n; i++)
+    base[i] = set->v;
+
+  // every search has the same steps, so all of them are done in lockstep
+  while (len > 1) {
+    half = len / 2;
+    for (i = 0; i < n; i++) {
+      __builtin_prefetch(base[i] + half / 2);
+      __builtin_prefetch(base[i] + half + half / 2);
+    }
+    for (i = 0; i < n; i++)
+      base[i] = base[i][half].net <= addrs[i] ? base[i] + half : base[i];
+    len -= half;
+  }
+
+  for (i = 0; i < n; i++) {
+    out[i] = -1;
+    if (set->n && base[i]->net <= addrs[i] &&
+        addrs[i] <= iap_pfx_last(base[i])) {
+      out[i] = base[i] - set->v;
+      found++;
+    }
+  }
+
+  return found;
+}
+
+size_t iap_lookup_batch(const iap_set_t *set, const unsigned int *addrs,
+                        size_t n, long *out) {
+  size_t i, c, found = 0;
+
+  for (i = 0; i < n; i += c) {
+    c = n - i < IAP_LOOKUP_GROUP ? n - i : IAP_LOOKUP_GROUP;
+    found += lookup_group(set, addrs + i, c, out + i);
+  }
+
+  return found;
+}
+
+int iap_pfx_ntoa(const iap_pfx_t *p, char *out) {
+  char *e = iap_fmt_pfx(out, p->net, p->cidr);
+
+  *e = '\0';
+  return e - out;
+}
+
+void iap_set_free(iap_set_t *set) {
+  set_changed(set);
+  if (set->map) {
+    iapb_close(set->map);
+    set->map = (void *)0;
+  } else
+    free(set->v);
+  set->v = (void *)0;
+  set->n = set->cap = 0;
+}
@@ -0,0 +1,195 @@
+#include "stats.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IAP_STATS_PHASES 16
+
+struct iap_stats iap_stats;
+
+struct stats_phase {
+  const char *name;
+  double wall, cpu;
+};
+
+/**
+ * Phases and current phase start, private part of statistics
+ */
+static struct {
+  const char *command, *path;
+  struct stats_phase phases[IAP_STATS_PHASES];
+  int n;
+  const char *current;
+  double wall, cpu;   // start of current phase
+  double wall0, cpu0; // start of command
+} stats;
+
+static double stats_clock(clockid_t id) {
+  struct timespec ts;
+
+  clock_gettime(id, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * add time of current phase to its entry
+ */
+static void stats_close(double wall, double cpu) {
+  int i;
+
+  if (!stats.current)
+    return;
+
+  for (i = 0; i < stats.n; i++)
+    if (strcmp(stats.phases[i].name, stats.current) == 0)
+      break;
+
+  if (i == stats.n) {
+    if (stats.n == IAP_STATS_PHASES)
+      return;
+    stats.phases[stats.n].name = stats.current;
+    stats.n++;
+  }
+
+  stats.phases[i].wall += wall - stats.wall;
+  stats.phases[i].cpu += cpu - stats.cpu;
+}
+
+int iap_stats_start(const char *command, const char *path) {
+#ifdef IAP_NO_STATS
+  return 0;
+#else
+  stats.command = command;
+  stats.path = path;
+  stats.wall0 = stats.wall = stats_clock(CLOCK_MONOTONIC);
+  stats.cpu0 = stats.cpu = stats_clock(CLOCK_PROCESS_CPUTIME_ID);
+  iap_stats.on = 1;
+  atexit(iap_stats_report);
+  return 1;
+#endif
+}
+
+void iap_stats_phase(const char *name) {
+  double wall, cpu;
+
+  if (!iap_stats.on)
+    return;
+
+  wall = stats_clock(CLOCK_MONOTONIC);
+  cpu = stats_clock(CLOCK_PROCESS_CPUTIME_ID);
+  stats_close(wall, cpu);
+
+  stats.current = name;
+  stats.wall = wall;
+  stats.cpu = cpu;
+}
+
+/**
+ * Counters in report order
+ */
+static const struct {
+  const char *name;
+  size_t off;
+  int tree; // counted by tree operations only
+} stats_counters[] = {
+    {"tokens", offsetof(struct iap_stats, tokens), 0},
+    {"collapsed", offsetof(struct iap_stats, collapsed), 0},
+    {"aggregated", offsetof(struct iap_stats, aggregated), 0},
+    {"set_allocs", offsetof(struct iap_stats, set_allocs), 0},
+    {"inserted", offsetof(struct iap_stats, inserted), 1},
+    {"prunes", offsetof(struct iap_stats, prunes), 1},
+    {"removed", offsetof(struct iap_stats, removed), 1},
+    {"rotations", offsetof(struct iap_stats, rotations), 1},
+    {"node_allocs", offsetof(struct iap_stats, node_allocs), 1},
+    {"chunk_allocs", offsetof(struct iap_stats, chunk_allocs), 1},
+    {"peak_nodes", offsetof(struct iap_stats, peak_nodes), 1},
+    {NULL}};
+
+static unsigned long long stats_counter(int i) {
+  return *(unsigned long long *)((char *)&iap_stats + stats_counters[i].off);
+}
+
+/**
+ * tree counters are left out when command built no tree
+ */
+static int stats_shown(int i) {
+  return !stats_counters[i].tree || iap_stats.node_allocs;
+}
+
+static void stats_print(FILE *f) {
+  int i;
+
+  for (i = 0; i < stats.n; i++)
+    fprintf(f, "stats: phase %-12s wall %.6f s cpu %.6f s\n",
+            stats.phases[i].name, stats.phases[i].wall, stats.phases[i].cpu);
+
+  fprintf(f, "stats: total %-12s wall %.6f s cpu %.6f s\n", stats.command,
+          stats.wall - stats.wall0, stats.cpu - stats.cpu0);
+
+  for (i = 0; stats_counters[i].name; i++)
+    if (stats_shown(i))
+      fprintf(f, "stats: %-18s %llu\n", stats_counters[i].name,
+              stats_counter(i));
+}
+
+static void stats_print_json(FILE *f) {
+  struct rusage ru;
+  int i;
+
+  fprintf(f, "{\n  \"command\": \"%s\",\n  \"wall_sec\": %.6f,\n"
+             "  \"cpu_sec\": %.6f,\n  \"phases\": [",
+          stats.command, stats.wall - stats.wall0, stats.cpu - stats.cpu0);
+
+  for (i = 0; i < stats.n; i++)
+    fprintf(f, "%s\n    {\"name\": \"%s\", \"wall_sec\": %.6f, \"cpu_sec\": %.6f}",
+            i ? "," : "", stats.phases[i].name, stats.phases[i].wall,
+            stats.phases[i].cpu);
+
+  fprintf(f, "\n  ],\n  \"counters\": {");
+  for (i = 0; stats_counters[i].name; i++)
+    if (stats_shown(i))
+      fprintf(f, "%s\n    \"%s\": %llu", i ? "," : "",
+              stats_counters[i].name, stats_counter(i));
+
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(f, "\n  },\n  \"peak_rss_kb\": %ld\n}\n", ru.ru_maxrss);
+}
+
+void iap_stats_report(void) {
+  struct rusage ru;
+  FILE *f;
+  int err;
+
+  if (!iap_stats.on)
+    return;
+
+  iap_stats_phase((void *)0);
+  iap_stats.on = 0;
+
+  // exit() must not be called again from exit handler, so failed write
+  // ends process with _exit() after streams are flushed
+  if (stats.path) {
+    f = fopen(stats.path, "w");
+    if (f) {
+      stats_print_json(f);
+      err = ferror(f);
+      if (fclose(f) != 0 || err)
+        f = (void *)0;
+    }
+    if (!f) {
+      fprintf(stderr, "Error: failed to write stats into '%s'\n", stats.path);
+      fflush((void *)0);
+      _exit(EXIT_FAILURE);
+    }
+    return;
+  }
+
+  stats_print(stderr);
+  getrusage(RUSAGE_SELF, &ru);
+  fprintf(stderr, "stats: %-18s %ld kB\n", "peak_rss", ru.ru_maxrss);
+}
@@ -0,0 +1,344 @@
+#include "core.h"
+#include "pool.h"
+#include "set.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef IAP_TRIE
+
+/*
+ * Path compressed binary trie backend. Set members are leaves of the trie.
+ * Inner node keeps common prefix of its subtrees in "a" and "cidr", subtrees
+ * differ in bit number "cidr" (0 is the highest bit). Inner node always has
+ * two children, so leaf is node without left child.
+ */
+
+#define IAP_TRIE_DEPTH 34
+
+static inline unsigned int trie_mask(int cidr) {
+  return cidr > 0 ? ~0U << (32 - cidr) : 0U;
+}
+
+static inline unsigned int trie_key(const iap_t *n) {
+  return ((unsigned int)n->a[0] << 24) | (n->a[1] << 16) | (n->a[2] << 8) |
+         n->a[3];
+}
+
+static inline int trie_leaf(const iap_t *n) { return !n->l; }
+
+/**
+ * return bit number "bit" of raw address
+ */
+static inline int trie_bit(unsigned int raw, int bit) {
+  return (raw >> (31 - bit)) & 1;
+}
+
+/**
+ * return length of common prefix of two keys, but no more than "max"
+ */
+static inline int trie_cpl(unsigned int a, unsigned int b, int max) {
+  unsigned int d = a ^ b;
+  int cpl = d ? __builtin_clz(d) : 32;
+  return cpl < max ? cpl : max;
+}
+
+/**
+ * recalculate height and nodes count of subtree from children
+ */
+static inline void fix(iap_t *n) {
+  if (trie_leaf(n)) {
+    n->avl_height = 1;
+    n->avl_count = 1;
+  } else {
+    n->avl_height = (n->l->avl_height > n->r->avl_height ? n->l->avl_height
+                                                          : n->r->avl_height) +
+                    1;
+    n->avl_count = n->l->avl_count + n->r->avl_count + 1;
+  }
+}
+
+static iap_t *trie_node(unsigned int raw, int cidr, iap_t *l, iap_t *r) {
+  iap_t *t = iap_node_alloc();
+
+  if (!t) {
+    fprintf(stderr, "Out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  t->a[0] = (raw >> 24) & 0xff;
+  t->a[1] = (raw >> 16) & 0xff;
+  t->a[2] = (raw >> 8) & 0xff;
+  t->a[3] = raw & 0xff;
+  t->cidr = cidr;
+  t->l = l;
+  t->r = r;
+  fix(t);
+
+  return t;
+}
+
+/**
+ * return all nodes of subtree into pool
+ */
+static void trie_release(iap_t *root) {
+  iap_t *t;
+
+  // flatten tree by right rotations and release nodes from the left end
+  while (root) {
+    if (root->l) {
+      t = root->l;
+      root->l = t->r;
+      t->r = root;
+      root = t;
+    } else {
+      t = root->r;
+      iap_node_release(root);
+      root = t;
+    }
+  }
+}
+
+/**
+ * replace inner node which lost child in "slot" by its other child
+ */
+static void trie_splice(iap_t **slot) {
+  iap_t *n = *slot;
+
+  *slot = n->l ? n->l : n->r;
+  iap_node_release(n);
+}
+
+static void trie_fix_path(iap_t ***stack, int sp) {
+  while (sp-- > 0)
+    if (*stack[sp])
+      fix(*stack[sp]);
+}
+
+iap_t *iap_insert(iap_t **root, const iap_t *new) {
+  iap_t **stack[IAP_TRIE_DEPTH];
+  iap_t **p = root, *n, *t;
+  unsigned int key = trie_key(new) & trie_mask(new->cidr);
+  int len = new->cidr, cpl, sp = 0;
+
+  while (*p) {
+    n = *p;
+    cpl = trie_cpl(key, trie_key(n), len < n->cidr ? len : n->cidr);
+
+    // existing member contains new prefix
+    if (cpl == n->cidr && trie_leaf(n))
+      return n;
+
+    // new prefix contains whole subtree
+    if (cpl == len) {
+      IAP_STAT_ADD(prunes, 1);
+      IAP_STAT_ADD(removed, (n->avl_count + 1) / 2);
+      IAP_STAT_ADD(inserted, 1);
+      trie_release(n);
+      t = *p = trie_node(key, len, (void *)0, (void *)0);
+      trie_fix_path(stack, sp);
+      return t;
+    }
+
+    if (cpl == n->cidr) {
+      stack[sp++] = p;
+      p = trie_bit(key, cpl) ? &n->r : &n->l;
+      continue;
+    }
+
+    // prefixes diverge in bit "cpl", split here
+    IAP_STAT_ADD(inserted, 1);
+    t = trie_node(key, len, (void *)0, (void *)0);
+    if (trie_bit(key, cpl))
+      *p = trie_node(key & trie_mask(cpl), cpl, n, t);
+    else
+      *p = trie_node(key & trie_mask(cpl), cpl, t, n);
+    trie_fix_path(stack, sp);
+    return t;
+  }
+
+  IAP_STAT_ADD(inserted, 1);
+  t = *p = trie_node(key, len, (void *)0, (void *)0);
+  return t;
+}
+
+/**
+ * find slot of node matching "net". With "exact" set only leaf with same
+ * prefix is matched, otherwise subtree contained in "net".
+ */
+static iap_t **trie_find(iap_t **root, const iap_t *net, int exact,
+                         iap_t ***stack, int *sp) {
+  iap_t **p = root, *n;
+  unsigned int key = trie_key(net) & trie_mask(net->cidr);
+  int len = net->cidr, cpl;
+
+  while (*p) {
+    n = *p;
+    cpl = trie_cpl(key, trie_key(n), len < n->cidr ? len : n->cidr);
+
+    if (cpl == len && (!exact || (trie_leaf(n) && n->cidr == len)))
+      return p;
+
+    if (cpl != n->cidr || trie_leaf(n))
+      break;
+
+    stack[(*sp)++] = p;
+    p = trie_bit(key, cpl) ? &n->r : &n->l;
+  }
+
+  return (void *)0;
+}
+
+static void trie_cut(iap_t **p, iap_t ***stack, int sp) {
+  // inner nodes have two children, so subtree has (count + 1) / 2 members
+  IAP_STAT_ADD(removed, ((*p)->avl_count + 1) / 2);
+  trie_release(*p);
+  *p = (void *)0;
+
+  if (sp > 0)
+    trie_splice(stack[--sp]);
+
+  trie_fix_path(stack, sp);
+}
+
+void iap_remove(iap_t **root, const iap_t *net) {
+  iap_t **stack[IAP_TRIE_DEPTH];
+  iap_t **p;
+  int sp = 0;
+
+  if ((p = trie_find(root, net, 1, stack, &sp)))
+    trie_cut(p, stack, sp);
+}
+
+void iap_prune(iap_t **root, const iap_t *net) {
+  iap_t **stack[IAP_TRIE_DEPTH];
+  iap_t **p;
+  int sp = 0;
+
+  IAP_STAT_ADD(prunes, 1);
+  if ((p = trie_find(root, net, 0, stack, &sp)))
+    trie_cut(p, stack, sp);
+}
+
+void iap_free(iap_t **root) {
+  if (*root && (*root)->avl_count == iap_pool.live)
+    iap_pool_reset();
+  else
+    trie_release(*root);
+
+  *root = (void *)0;
+}
+
+/**
+ * build trie from sorted disjoint prefixes
+ */
+static iap_t *trie_build_fast(const iap_pfx_t *v, size_t n) {
+  size_t lo = 1, hi = n - 1, mid;
+  int cpl;
+
+  if (n == 1)
+    return trie_node(v[0].net, v[0].cidr, (void *)0, (void *)0);
+
+  // first and last prefixes differ in bit "cpl", find first prefix with
+  // this bit set
+  cpl = __builtin_clz(v[0].net ^ v[n - 1].net);
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (trie_bit(v[mid].net, cpl))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return trie_node(v[0].net & trie_mask(cpl), cpl, trie_build_fast(v, lo),
+                   trie_build_fast(v + lo, n - lo));
+}
+
+int iap_set_tree(const iap_set_t *set, iap_t **root) {
+  *root = set->n ? trie_build_fast(set->v, set->n) : (void *)0;
+  return 1;
+}
+
+static void trie_walk_fast(const iap_t *root, int level, void *data,
+                           iap_walk_proc_p proc) {
+  if (!trie_leaf(root)) {
+    trie_walk_fast(root->l, level + 1, data, proc);
+    trie_walk_fast(root->r, level + 1, data, proc);
+    return;
+  }
+
+  proc(root, level, IAP_WALK_PREORDER, data);
+  proc(root, level, IAP_WALK_INORDER, data);
+  proc(root, level, IAP_WALK_POSTORDER, data);
+}
+
+void iap_walk(const iap_t *root, iap_walk_proc_p proc, void *data) {
+  if (root)
+    trie_walk_fast(root, 0, data, proc);
+}
+
+/*
+ * Iterator stack keeps subtrees not visited yet, next leaf is found by going
+ * left from top of stack.
+ */
+
+static inline const iap_t *trie_iter_next_fast(iap_iter_t *it) {
+  const iap_t *n;
+
+  if (!it->sp)
+    return (void *)0;
+
+  for (n = it->stack[--it->sp]; !trie_leaf(n); n = n->l)
+    it->stack[it->sp++] = n->r;
+
+  return n;
+}
+
+void iap_iter_init(iap_iter_t *it, const iap_t *root) {
+  it->sp = 0;
+  if (root)
+    it->stack[it->sp++] = root;
+}
+
+void iap_iter_seek(iap_iter_t *it, const iap_t *root, unsigned int raw) {
+  const iap_t *n = root;
+  unsigned int key;
+
+  it->sp = 0;
+  while (n) {
+    key = trie_key(n);
+
+    // whole subtree is before or after address
+    if ((raw & trie_mask(n->cidr)) != key) {
+      if (key > raw)
+        it->stack[it->sp++] = n;
+      return;
+    }
+
+    if (trie_leaf(n)) {
+      it->stack[it->sp++] = n;
+      return;
+    }
+
+    if (trie_bit(raw, n->cidr))
+      n = n->r;
+    else {
+      it->stack[it->sp++] = n->r;
+      n = n->l;
+    }
+  }
+}
+
+const iap_t *iap_iter_next(iap_iter_t *it) { return trie_iter_next_fast(it); }
+
+size_t iap_iter_next_n(iap_iter_t *it, const iap_t **out, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n && (out[i] = trie_iter_next_fast(it)); i++)
+    ;
+
+  return i;
+}
+
+#endif
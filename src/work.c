@@ -0,0 +1,114 @@
+#include "work.h"
+
+#include <pthread.h>
+
+/**
+ * Tasks from head to tail are waiting, owner takes head, thieves take tail
+ */
+struct work_queue {
+  pthread_mutex_t lock;
+  size_t head, tail;
+};
+
+struct work_ctx {
+  struct work_queue queues[IAP_WORK_THREADS_MAX];
+  int threads;
+  iap_work_p proc;
+  void *data;
+};
+
+struct work_thread {
+  struct work_ctx *ctx;
+  int id;
+};
+
+/**
+ * take next task of own queue or steal from the longest queue. Return 0 if
+ * there is no task left.
+ */
+static int work_take(struct work_ctx *ctx, int id, size_t *task) {
+  struct work_queue *q = &ctx->queues[id];
+  size_t most, left;
+  int i, victim;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) {
+    *task = q->head++;
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  for (;;) {
+    for (i = 0, victim = -1, most = 0; i < ctx->threads; i++) {
+      q = &ctx->queues[i];
+      pthread_mutex_lock(&q->lock);
+      left = q->tail - q->head;
+      pthread_mutex_unlock(&q->lock);
+      if (left > most) {
+        most = left;
+        victim = i;
+      }
+    }
+    if (victim < 0)
+      return 0;
+
+    // queue may be emptied since it was measured, then look again
+    q = &ctx->queues[victim];
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+      *task = --q->tail;
+      pthread_mutex_unlock(&q->lock);
+      return 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+  }
+}
+
+static void *work_thread_run(void *arg) {
+  struct work_thread *t = arg;
+  size_t task;
+
+  while (work_take(t->ctx, t->id, &task))
+    t->ctx->proc(task, t->ctx->data);
+
+  return (void *)0;
+}
+
+void iap_work_run(size_t n, int threads, iap_work_p proc, void *data) {
+  struct work_thread th[IAP_WORK_THREADS_MAX];
+  pthread_t ids[IAP_WORK_THREADS_MAX];
+  int started[IAP_WORK_THREADS_MAX];
+  struct work_ctx ctx;
+  int i;
+
+  if (threads > IAP_WORK_THREADS_MAX)
+    threads = IAP_WORK_THREADS_MAX;
+  if ((size_t)threads > n)
+    threads = n;
+  if (threads < 1)
+    threads = 1;
+
+  ctx.threads = threads;
+  ctx.proc = proc;
+  ctx.data = data;
+  for (i = 0; i < threads; i++) {
+    pthread_mutex_init(&ctx.queues[i].lock, (void *)0);
+    ctx.queues[i].head = n / threads * i;
+    ctx.queues[i].tail = i == threads - 1 ? n : n / threads * (i + 1);
+    th[i].ctx = &ctx;
+    th[i].id = i;
+  }
+
+  // tasks of thread which can not be created are stolen by others
+  for (i = 1; i < threads; i++)
+    started[i] =
+        pthread_create(&ids[i], (void *)0, work_thread_run, &th[i]) == 0;
+  work_thread_run(&th[0]);
+
+  for (i = 1; i < threads; i++)
+    if (started[i])
+      pthread_join(ids[i], (void *)0);
+  for (i = 0; i < threads; i++)
+    pthread_mutex_destroy(&ctx.queues[i].lock);
+}
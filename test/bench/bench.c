@@ -0,0 +1,328 @@
+#include "arg.h"
+#include "cmd.h"
+#include "core.h"
+#include "gen.h"
+#include "iap.h"
+#include "set.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_PATH_MAX 4096
+// queries searched together by lookup-batch stage
+#define BENCH_LOOKUP_BATCH 4096
+
+#define BENCH_USAGE                                                            \
+  "Usage: iap-bench gen <kind> [count] [seed]\n"                               \
+  "       iap-bench run [--count N] [--queries N] [--seed N] [--dir DIR]\n"    \
+  "                     [-o FILE]\n\n"                                         \
+  "Kinds of datasets: random, bgp, dense, dup.\n"
+
+/**
+ * Dataset and queries used by every stage
+ */
+struct bench_ctx {
+  char data[BENCH_PATH_MAX];    // "@path" of dataset
+  char queries[BENCH_PATH_MAX]; // "@path" of queries
+  char limit[32];               // addresses printed by inflate
+  size_t count, nqueries;
+  size_t bytes, qbytes;
+};
+
+/**
+ * Benchmark stage, runs in own process with stdout sent to /dev/null
+ */
+struct bench_stage {
+  const char *name;
+  void (*run)(struct bench_ctx *ctx);
+  int queries; // stage processes queries, not dataset
+};
+
+static void stage_parse(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data};
+  iap_set_t set = {0};
+
+  parse_ips_set(1, argv, &set);
+  iap_set_free(&set);
+}
+
+static void stage_insert(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data};
+  iap_t *root = (void *)0;
+
+  parse_ips(1, argv, &root);
+  iap_free(&root);
+}
+
+/**
+ * Same tree as insert stage, built at once from normalized set
+ */
+static void stage_insert_bulk(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data};
+  iap_t *root = (void *)0;
+
+  parse_ips_bulk(1, argv, &root);
+  iap_free(&root);
+}
+
+static void stage_deflate(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data};
+  cmd_deflate(1, argv);
+}
+
+static void stage_inflate(struct bench_ctx *ctx) {
+  char *argv[] = {"--limit", ctx->limit, ctx->data};
+  cmd_inflate(3, argv);
+}
+
+static void stage_invert(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data};
+  cmd_invert(1, argv);
+}
+
+static void stage_filter(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data, ctx->queries};
+  cmd_filter(2, argv);
+}
+
+static void stage_lookup(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data, ctx->queries};
+  cmd_lookup(2, argv);
+}
+
+/**
+ * Queries collected for iap_lookup_batch
+ */
+struct lookup_batch {
+  const iap_set_t *set;
+  unsigned int addrs[BENCH_LOOKUP_BATCH];
+  long found[BENCH_LOOKUP_BATCH];
+  size_t n, total;
+};
+
+static void lookup_batch_flush(struct lookup_batch *b) {
+  b->total += iap_lookup_batch(b->set, b->addrs, b->n, b->found);
+  b->n = 0;
+}
+
+static void lookup_batch_proc(const char *str, int len, unsigned int from,
+                              unsigned int to, void *data) {
+  struct lookup_batch *b = data;
+
+  b->addrs[b->n++] = from;
+  if (b->n == BENCH_LOOKUP_BATCH)
+    lookup_batch_flush(b);
+}
+
+/**
+ * Same queries as lookup stage, searched in set by interleaved binary search
+ * instead of lookup table
+ */
+static void stage_lookup_batch(struct bench_ctx *ctx) {
+  char *argv[] = {ctx->data}, *qargv[] = {ctx->queries};
+  iap_set_t set = {0};
+  struct lookup_batch *b;
+
+  parse_ips_set(1, argv, &set);
+  b = calloc(1, sizeof(*b));
+  if (!b)
+    FAILURE("Error: failed to allocate memory\n");
+
+  b->set = &set;
+  parse_ips_stream(1, qargv, lookup_batch_proc, b, 0);
+  lookup_batch_flush(b);
+  printf("%zu\n", b->total);
+
+  free(b);
+  iap_set_free(&set);
+}
+
+static const struct bench_stage stages[] = {
+    {"parse", stage_parse, 0},
+    {"insert", stage_insert, 0},
+    {"insert-bulk", stage_insert_bulk, 0},
+    {"deflate", stage_deflate, 0},
+    {"inflate", stage_inflate, 0},
+    {"invert", stage_invert, 0},
+    {"filter", stage_filter, 1},
+    {"lookup", stage_lookup, 1},
+    {"lookup-batch", stage_lookup_batch, 1},
+    {NULL}};
+
+static double bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Run stage in child process. Child reports elapsed time through pipe, peak
+ * RSS of child is taken from wait4(). Return 0 if stage failed.
+ */
+static int bench_stage_run(const struct bench_stage *stage,
+                           struct bench_ctx *ctx, double *seconds,
+                           long *rss_kb) {
+  struct rusage ru;
+  double t;
+  pid_t pid;
+  int fd[2], status, null;
+
+  if (pipe(fd) != 0)
+    FAILURE("Error: pipe: %s\n", strerror(errno));
+
+  // buffered output must not be written again by failed child
+  fflush((void *)0);
+  pid = fork();
+  if (pid < 0)
+    FAILURE("Error: fork: %s\n", strerror(errno));
+
+  if (pid == 0) {
+    close(fd[0]);
+    null = open("/dev/null", O_WRONLY);
+    if (null < 0 || dup2(null, STDOUT_FILENO) < 0)
+      _exit(EXIT_FAILURE);
+
+    t = bench_now();
+    stage->run(ctx);
+    fflush(stdout);
+    t = bench_now() - t;
+
+    if (write(fd[1], &t, sizeof(t)) != sizeof(t))
+      _exit(EXIT_FAILURE);
+    _exit(0);
+  }
+
+  close(fd[1]);
+  if (read(fd[0], seconds, sizeof(*seconds)) != sizeof(*seconds))
+    *seconds = -1;
+  close(fd[0]);
+
+  while (wait4(pid, &status, 0, &ru) < 0)
+    if (errno != EINTR)
+      FAILURE("Error: wait4: %s\n", strerror(errno));
+
+  *rss_kb = ru.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 && *seconds >= 0;
+}
+
+/**
+ * write dataset into file, return its size
+ */
+static size_t bench_gen_file(const char *path, int kind, size_t count,
+                             unsigned long long seed) {
+  FILE *f = fopen(path, "w");
+  size_t bytes;
+
+  if (!f)
+    FAILURE("Error: failed to open '%s': %s\n", path, strerror(errno));
+
+  bytes = gen_write(f, kind, count, seed);
+  if (fclose(f) != 0 || !bytes)
+    FAILURE("Error: failed to write '%s'\n", path);
+
+  return bytes;
+}
+
+static int bench_gen(int argc, char **argv) {
+  unsigned long long count = 1000000, seed = 1;
+  int kind;
+
+  if (argc < 1 || (kind = gen_kind(argv[0])) < 0)
+    FAILURE("Error: unknown kind of dataset.\n\n" BENCH_USAGE);
+  if (argc > 1)
+    count = strtoull(argv[1], NULL, 10);
+  if (argc > 2)
+    seed = strtoull(argv[2], NULL, 10);
+
+  if (!gen_write(stdout, kind, count, seed))
+    FAILURE("Error: failed to write output\n");
+
+  return 0;
+}
+
+static int bench_run(int argc, char **argv) {
+  arg_opt_t opts[] = {{"count", 1},        {"queries", 1}, {"seed", 1},
+                      {"dir", 1},          {"output", 1, NULL, 'o'},
+                      {NULL}};
+  struct bench_ctx ctx = {0};
+  const struct bench_stage *stage;
+  const char *dir;
+  unsigned long long seed;
+  double seconds, ops, bytes;
+  long rss;
+  FILE *out = stdout;
+  int kind, ok, first = 1;
+
+  arg_parse(argc, argv, opts);
+  ctx.count = arg_ull(&opts[0], 1000000);
+  ctx.nqueries = arg_ull(&opts[1], ctx.count);
+  seed = arg_ull(&opts[2], 1);
+  dir = opts[3].value ? opts[3].value : ".";
+
+  if (opts[4].value && !(out = fopen(opts[4].value, "w")))
+    FAILURE("Error: failed to open '%s': %s\n", opts[4].value,
+            strerror(errno));
+
+  snprintf(ctx.limit, sizeof(ctx.limit), "%zu", ctx.count);
+  snprintf(ctx.queries, sizeof(ctx.queries), "@%s/bench-queries.txt", dir);
+  ctx.qbytes =
+      bench_gen_file(ctx.queries + 1, GEN_RANDOM, ctx.nqueries, seed + 1);
+
+  fprintf(out, "{\n  \"count\": %zu,\n  \"queries\": %zu,\n  \"seed\": %llu,\n"
+               "  \"results\": [",
+          ctx.count, ctx.nqueries, seed);
+
+  for (kind = 0; kind < GEN_KINDS; kind++) {
+    snprintf(ctx.data, sizeof(ctx.data), "@%s/bench-%s.txt", dir,
+             gen_kind_names[kind]);
+    ctx.bytes = bench_gen_file(ctx.data + 1, kind, ctx.count, seed);
+
+    for (stage = stages; stage->name; stage++) {
+      ok = bench_stage_run(stage, &ctx, &seconds, &rss);
+      ops = stage->queries ? ctx.nqueries : ctx.count;
+      bytes = stage->queries ? ctx.qbytes : ctx.bytes;
+
+      fprintf(out, "%s\n    {\"dataset\": \"%s\", \"stage\": \"%s\", ",
+              first ? "" : ",", gen_kind_names[kind], stage->name);
+      if (ok && seconds > 0)
+        fprintf(out,
+                "\"items\": %.0f, \"bytes\": %.0f, \"seconds\": %.6f, "
+                "\"items_per_sec\": %.0f, \"mb_per_sec\": %.2f, "
+                "\"ns_per_op\": %.2f, \"peak_rss_kb\": %ld}",
+                ops, bytes, seconds, ops / seconds, bytes / seconds / 1e6,
+                seconds * 1e9 / (ops ? ops : 1), rss);
+      else
+        fprintf(out, "\"error\": \"stage failed\"}");
+      fflush(out);
+      first = 0;
+    }
+
+    unlink(ctx.data + 1);
+  }
+
+  fprintf(out, "\n  ]\n}\n");
+  unlink(ctx.queries + 1);
+
+  if (out != stdout && fclose(out) != 0)
+    FAILURE("Error: failed to write '%s'\n", opts[4].value);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "gen") == 0)
+    return bench_gen(argc - 2, argv + 2);
+  if (argc >= 2 && strcmp(argv[1], "run") == 0)
+    return bench_run(argc - 2, argv + 2);
+
+  fprintf(stderr, "Error: Invalid command.\n\n" BENCH_USAGE);
+  return 1;
+}
@@ -0,0 +1,133 @@
+#include "gen.h"
+#include "core.h"
+#include "set.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_DENSE_REGIONS 16
+#define GEN_DUP_RATIO 100
+
+const char *gen_kind_names[GEN_KINDS] = {"random", "bgp", "dense", "dup"};
+
+/**
+ * Share of prefix lengths /8 - /32 in per mille, close to public BGP table
+ */
+static const int gen_bgp_lengths[25] = {
+    1, 1, 1, 2, 4, 7, 8, 8, 13, 8, 15, 30, 50, 50, 120, 100, 569,
+    0, 0, 0, 0, 0, 0, 0, 13};
+
+struct gen_rng {
+  unsigned long long s;
+};
+
+/**
+ * xorshift64* generator
+ */
+static inline unsigned int gen_next(struct gen_rng *r) {
+  r->s ^= r->s >> 12;
+  r->s ^= r->s << 25;
+  r->s ^= r->s >> 27;
+  return (r->s * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static iap_pfx_t gen_bgp(struct gen_rng *r) {
+  iap_pfx_t p;
+  int i, x = gen_next(r) % 1000;
+
+  for (i = 0; i < 24 && x >= gen_bgp_lengths[i]; i++)
+    x -= gen_bgp_lengths[i];
+
+  p.cidr = 8 + i;
+  p.net = gen_next(r) & iap_mask(p.cidr);
+  return p;
+}
+
+static int gen_line(char *out, unsigned int from, unsigned int to) {
+  iap_pfx_t a = {from, 32}, b = {to, 32};
+  int n;
+
+  n = iap_pfx_ntoa(&a, out);
+  if (from != to) {
+    out[n++] = '-';
+    n += iap_pfx_ntoa(&b, out + n);
+  }
+  out[n++] = '\n';
+  return n;
+}
+
+int gen_kind(const char *name) {
+  int i;
+
+  for (i = 0; i < GEN_KINDS; i++)
+    if (strcmp(gen_kind_names[i], name) == 0)
+      return i;
+
+  return -1;
+}
+
+size_t gen_write(FILE *f, int kind, size_t count, unsigned long long seed) {
+  struct gen_rng r = {seed * 0x9E3779B97F4A7C15ULL + 1};
+  unsigned int regions[GEN_DENSE_REGIONS], cursor[GEN_DENSE_REGIONS];
+  char line[2 * IAP_BEST_LEN + 2];
+  iap_pfx_t *pool = (void *)0, p;
+  size_t i, npool = 0, bytes = 0;
+  unsigned int span;
+  int n, k;
+
+  if (kind == GEN_DENSE) {
+    for (k = 0; k < GEN_DENSE_REGIONS; k++)
+      regions[k] = cursor[k] = gen_next(&r) & 0xffff0000;
+  }
+
+  if (kind == GEN_DUP) {
+    npool = count / GEN_DUP_RATIO + 1;
+    pool = malloc(npool * sizeof(iap_pfx_t));
+    if (!pool)
+      return 0;
+    for (i = 0; i < npool; i++)
+      pool[i] = gen_bgp(&r);
+  }
+
+  for (i = 0; i < count; i++) {
+    switch (kind) {
+    case GEN_RANDOM:
+      p.net = gen_next(&r);
+      p.cidr = 32;
+      n = iap_pfx_ntoa(&p, line);
+      line[n++] = '\n';
+      break;
+    case GEN_BGP:
+      p = gen_bgp(&r);
+      n = iap_pfx_ntoa(&p, line);
+      line[n++] = '\n';
+      break;
+    case GEN_DENSE:
+      // mostly next address of region, sometimes range, region wraps
+      // inside its /16
+      k = gen_next(&r) % GEN_DENSE_REGIONS;
+      span = gen_next(&r) % 8 ? 1 : gen_next(&r) % 1024 + 1;
+      cursor[k] += gen_next(&r) % 4;
+      if ((cursor[k] & 0xffff0000) != regions[k] ||
+          (cursor[k] & 0xffff) + span > 0x10000)
+        cursor[k] = regions[k];
+      n = gen_line(line, cursor[k], cursor[k] + span - 1);
+      cursor[k] += span;
+      break;
+    default:
+      p = pool[gen_next(&r) % npool];
+      n = iap_pfx_ntoa(&p, line);
+      line[n++] = '\n';
+      break;
+    }
+
+    if (fwrite(line, 1, n, f) != (size_t)n) {
+      free(pool);
+      return 0;
+    }
+    bytes += n;
+  }
+
+  free(pool);
+  return bytes;
+}
@@ -0,0 +1,41 @@
+#ifndef gen_h
+#define gen_h
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Kinds of synthetic datasets
+ */
+enum {
+  GEN_RANDOM = 0, // random /32 addresses
+  GEN_BGP = 1,    // prefixes with lengths distributed like BGP table
+  GEN_DENSE = 2,  // runs of adjacent addresses and ranges in few /16s
+  GEN_DUP = 3,    // BGP like prefixes, every one repeated about 100 times
+  GEN_KINDS = 4
+};
+
+extern const char *gen_kind_names[GEN_KINDS];
+
+/**
+ * @brief Find kind of dataset by name
+ *
+ * @param[in] name name of kind
+ * @return kind or -1 if name is unknown
+ */
+int gen_kind(const char *name);
+/**
+ * @brief Write dataset
+ *
+ * Write "count" lines of dataset of given kind. Same seed gives same
+ * dataset.
+ *
+ * @param[in] f output stream
+ * @param[in] kind GEN_* kind
+ * @param[in] count count of lines
+ * @param[in] seed random seed
+ * @return count of written bytes or 0 if write failed
+ */
+size_t gen_write(FILE *f, int kind, size_t count, unsigned long long seed);
+
+#endif
@@ -0,0 +1,108 @@
+# Golden output tests, run by "test" target:
+#   cmake -DIAP=<iap binary> -DWORK=<scratch dir> -P run_tests.cmake
+#
+# Every line of datasets/<command>.csv is one test "args; expected". Args are
+# passed to "iap <command>" run in datasets directory, leading --in-format=
+# and --out-format= go before command, "< file" at the end is sent to stdin
+# and ${WORK} is replaced by scratch directory. Expected text output has lines
+# joined by ", " and tabs replaced by space, binary output is compared as hex
+# string.
+
+if(NOT IAP OR NOT WORK)
+  message(FATAL_ERROR "IAP and WORK must be set")
+endif()
+
+set(DATA ${CMAKE_CURRENT_LIST_DIR}/datasets)
+file(MAKE_DIRECTORY ${WORK})
+
+# inputs which depend on build: compiled set and binary address list
+execute_process(COMMAND ${IAP} compile --index -o ${WORK}/set.iapb
+                        @lists/set.txt
+                WORKING_DIRECTORY ${DATA} RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "failed to compile lists/set.txt")
+endif()
+execute_process(COMMAND ${IAP} --out-format=bin inflate @lists/addrs.txt
+                WORKING_DIRECTORY ${DATA} OUTPUT_FILE ${WORK}/addrs.bin
+                RESULT_VARIABLE rc)
+if(NOT rc EQUAL 0)
+  message(FATAL_ERROR "failed to convert lists/addrs.txt")
+endif()
+
+# junk token longer than token limit runs over end of first 1 MiB block of
+# stdin, its rest must not be taken for address
+string(REPEAT "x" 1048276 junk)
+string(REPEAT "1" 299 digits)
+file(WRITE ${WORK}/junk.txt "${junk} ${digits}10.0.0.5\n10.0.0.6\n")
+
+set(total 0)
+set(failed 0)
+
+file(GLOB csvs ${DATA}/*.csv)
+foreach(csv ${csvs})
+  get_filename_component(command ${csv} NAME_WE)
+  file(READ ${csv} text)
+  # ";" separates lists in cmake
+  string(REPLACE ";" "|" text "${text}")
+  string(REPLACE "\n" ";" lines "${text}")
+
+  foreach(line ${lines})
+    if(NOT line MATCHES "^([^|]*)\\|(.*)$")
+      continue()
+    endif()
+    string(STRIP "${CMAKE_MATCH_1}" args)
+    string(STRIP "${CMAKE_MATCH_2}" expected)
+    string(CONFIGURE "${args}" args)
+    separate_arguments(argv UNIX_COMMAND "${args}")
+
+    set(input)
+    list(FIND argv "<" i)
+    if(NOT i EQUAL -1)
+      math(EXPR j "${i} + 1")
+      list(GET argv ${j} input)
+      list(SUBLIST argv 0 ${i} argv)
+      set(input INPUT_FILE ${input})
+    endif()
+
+    set(global)
+    set(binary 0)
+    while(argv)
+      list(GET argv 0 arg)
+      if(NOT arg MATCHES "^--(in|out)-format=")
+        break()
+      endif()
+      if(arg MATCHES "^--out-format=bin")
+        set(binary 1)
+      endif()
+      list(APPEND global ${arg})
+      list(REMOVE_AT argv 0)
+    endwhile()
+
+    math(EXPR total "${total} + 1")
+    execute_process(COMMAND ${IAP} ${global} ${command} ${argv}
+                    WORKING_DIRECTORY ${DATA} ${input} OUTPUT_FILE ${WORK}/out
+                    ERROR_VARIABLE err RESULT_VARIABLE rc)
+
+    if(binary)
+      file(READ ${WORK}/out out HEX)
+    else()
+      file(READ ${WORK}/out out)
+      string(REGEX REPLACE "\n$" "" out "${out}")
+      string(REPLACE "\t" " " out "${out}")
+      string(REPLACE "\n" ", " out "${out}")
+    endif()
+
+    if(NOT rc EQUAL 0 OR NOT out STREQUAL expected)
+      math(EXPR failed "${failed} + 1")
+      message("FAIL ${command} ${args}\n"
+              "  expected: ${expected}\n"
+              "  actual:   ${out}\n"
+              "  status:   ${rc} ${err}")
+    endif()
+  endforeach()
+endforeach()
+
+if(failed)
+  message(FATAL_ERROR "${failed} of ${total} tests failed")
+endif()
+message("${total} tests passed")
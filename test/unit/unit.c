@@ -0,0 +1,384 @@
+#include "core.h"
+#include "iapb.h"
+#include "lpm.h"
+#include "set.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// prefixes of random test set
+#define UNIT_SET_SIZE 4000
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: ", __FILE__, __LINE__);                          \
+      fprintf(stderr, __VA_ARGS__);                                            \
+      fprintf(stderr, "\n");                                                   \
+      failed++;                                                                \
+    }                                                                          \
+  } while (0)
+
+static int failed;
+static unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * xorshift generator, same sequence on every run
+ */
+static unsigned int rnd(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed >> 32;
+}
+
+/**
+ * normalized set of random prefixes /8 to /32
+ */
+static void random_set(iap_set_t *set, size_t n) {
+  size_t i;
+  int cidr;
+
+  for (i = 0; i < n; i++) {
+    cidr = 8 + rnd() % 25;
+    if (!iap_set_push(set, rnd() & iap_mask(cidr), cidr)) {
+      fprintf(stderr, "failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (!iap_set_normalize(set)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * index of prefix containing address by linear scan, -1 if none
+ */
+static long find_slow(const iap_set_t *set, unsigned int addr) {
+  size_t i;
+
+  for (i = 0; i < set->n; i++)
+    if (set->v[i].net <= addr && addr <= iap_pfx_last(&set->v[i]))
+      return i;
+
+  return -1;
+}
+
+/**
+ * random addresses and addresses around every prefix boundary
+ */
+static size_t queries(const iap_set_t *set, unsigned int **addrs) {
+  size_t i, n = 0;
+
+  *addrs = malloc((set->n * 4 + 1002) * sizeof(unsigned int));
+  if (!*addrs) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  (*addrs)[n++] = 0;
+  (*addrs)[n++] = 0xffffffffU;
+  for (i = 0; i < 1000; i++)
+    (*addrs)[n++] = rnd();
+  for (i = 0; i < set->n; i++) {
+    (*addrs)[n++] = set->v[i].net;
+    (*addrs)[n++] = set->v[i].net - 1;
+    (*addrs)[n++] = iap_pfx_last(&set->v[i]);
+    (*addrs)[n++] = iap_pfx_last(&set->v[i]) + 1;
+  }
+
+  return n;
+}
+
+static void test_lookup_batch(void) {
+  iap_set_t set = {0};
+  unsigned int *addrs;
+  size_t i, n, found = 0;
+  long *out, expect;
+
+  // empty set and group smaller than one batch
+  n = queries(&set, &addrs);
+  out = malloc(n * sizeof(long));
+  CHECK(out && iap_lookup_batch(&set, addrs, n, out) == 0,
+        "lookup in empty set found address");
+
+  random_set(&set, UNIT_SET_SIZE);
+  free(addrs);
+  free(out);
+  n = queries(&set, &addrs);
+  out = malloc(n * sizeof(long));
+  if (!out) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // odd count leaves last group partial
+  n -= n % 2 ? 0 : 1;
+  for (i = 0; i < n; i++)
+    found += find_slow(&set, addrs[i]) >= 0;
+  CHECK(iap_lookup_batch(&set, addrs, n, out) == found,
+        "lookup batch found count differs");
+
+  for (i = 0; i < n; i++) {
+    expect = find_slow(&set, addrs[i]);
+    CHECK(out[i] == expect, "lookup %08x: %ld, expected %ld", addrs[i],
+          out[i], expect);
+  }
+
+  free(addrs);
+  free(out);
+  iap_set_free(&set);
+}
+
+/**
+ * count of addresses of set lower than address by linear scan
+ */
+static unsigned long long rank_slow(const iap_set_t *set, unsigned int addr) {
+  unsigned long long r = 0;
+  size_t i;
+
+  for (i = 0; i < set->n && set->v[i].net < addr; i++)
+    r += addr <= iap_pfx_last(&set->v[i]) ? addr - set->v[i].net
+                                           : 1ULL << (32 - set->v[i].cidr);
+
+  return r;
+}
+
+static void test_rank_select(void) {
+  iap_set_t set = {0};
+  unsigned long long r = 0, size;
+  unsigned int *addrs, a;
+  size_t i, n;
+
+  random_set(&set, UNIT_SET_SIZE);
+  if (!iap_set_sums(&set)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  n = queries(&set, &addrs);
+  for (i = 0; i < n; i++)
+    CHECK(iap_rank(&set, addrs[i]) == rank_slow(&set, addrs[i]),
+          "rank %08x: %llu, expected %llu", addrs[i], iap_rank(&set, addrs[i]),
+          rank_slow(&set, addrs[i]));
+
+  // first and last address of every prefix
+  for (i = 0; i < set.n; i++) {
+    size = 1ULL << (32 - set.v[i].cidr);
+    CHECK(iap_select(&set, r, &a) && a == set.v[i].net,
+          "select %llu: %08x, expected %08x", r, a, set.v[i].net);
+    CHECK(iap_select(&set, r + size - 1, &a) && a == iap_pfx_last(&set.v[i]),
+          "select %llu: %08x, expected %08x", r + size - 1, a,
+          iap_pfx_last(&set.v[i]));
+    r += size;
+  }
+  CHECK(!iap_select(&set, r, &a), "select past last address succeeded");
+
+  // sums are dropped by change of set
+  iap_set_aggregate(&set);
+  CHECK(!set.sums, "prefix sums kept after change of set");
+
+  free(addrs);
+  iap_set_free(&set);
+
+  // whole address space, count does not fit into 32 bits
+  if (!iap_set_push(&set, 0, 0) || !iap_set_sums(&set)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  CHECK(iap_rank(&set, 0xffffffffU) == 0xffffffffULL,
+        "rank of last address of full set");
+  CHECK(iap_select(&set, 0xffffffffULL, &a) && a == 0xffffffffU,
+        "select of last address of full set");
+  CHECK(!iap_select(&set, 1ULL << 32, &a), "select past full set succeeded");
+  iap_set_free(&set);
+}
+
+/**
+ * index of first prefix of set ending at or after address, set->n if none
+ */
+static size_t seek_slow(const iap_set_t *set, unsigned int addr) {
+  size_t i;
+
+  for (i = 0; i < set->n && iap_pfx_last(&set->v[i]) < addr; i++)
+    ;
+
+  return i;
+}
+
+static int same_pfx(const iap_t *t, const iap_pfx_t *p) {
+  return t && iap_raw(t) == p->net && t->cidr == p->cidr;
+}
+
+/**
+ * iterate tree built from normalized set, members must follow set
+ */
+static void check_iter(const iap_set_t *set, const iap_t *root) {
+  const iap_t *t, *out[7];
+  unsigned int *addrs, mid;
+  size_t i, j, k, n, c;
+  iap_iter_t it;
+
+  iap_iter_init(&it, root);
+  for (i = 0; i < set->n; i++)
+    CHECK(same_pfx(iap_iter_next(&it), &set->v[i]), "member %zu differs", i);
+  CHECK(!iap_iter_next(&it), "member after end of tree");
+
+  iap_iter_init(&it, root);
+  for (i = 0; (c = iap_iter_next_n(&it, out, 7)); i += c)
+    for (j = 0; j < c; j++)
+      CHECK(i + j < set->n && same_pfx(out[j], &set->v[i + j]),
+            "member %zu of batch differs", i + j);
+  CHECK(i == set->n, "batches hold %zu members, expected %zu", i, set->n);
+
+  // boundaries and middle of every prefix, next member follows sought one
+  n = queries(set, &addrs);
+  for (i = 0; i < n; i++) {
+    k = seek_slow(set, addrs[i]);
+    iap_iter_seek(&it, root, addrs[i]);
+    t = iap_iter_next(&it);
+    if (k == set->n) {
+      CHECK(!t, "seek %08x past end returned member", addrs[i]);
+      continue;
+    }
+
+    CHECK(same_pfx(t, &set->v[k]), "seek %08x: wrong member", addrs[i]);
+    t = iap_iter_next(&it);
+    CHECK(k + 1 == set->n ? !t : same_pfx(t, &set->v[k + 1]),
+          "seek %08x: wrong member after sought one", addrs[i]);
+  }
+
+  for (i = 0; i < set->n; i++) {
+    mid = set->v[i].net + (iap_pfx_last(&set->v[i]) - set->v[i].net) / 2;
+    iap_iter_seek(&it, root, mid);
+    CHECK(same_pfx(iap_iter_next(&it), &set->v[i]),
+          "seek into middle of member %zu", i);
+  }
+
+  free(addrs);
+}
+
+static void test_iter(void) {
+  iap_set_t set = {0};
+  iap_t *root = (void *)0;
+  iap_iter_t it;
+
+  // empty tree
+  iap_iter_init(&it, root);
+  CHECK(!iap_iter_next(&it), "member of empty tree");
+  iap_iter_seek(&it, root, 0);
+  CHECK(!iap_iter_next(&it), "seek in empty tree returned member");
+
+  // seek past last member
+  if (!iap_set_push(&set, 0x0a000000U, 8) ||
+      !iap_set_push(&set, 0xc0a80000U, 16) || !iap_set_tree(&set, &root)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  check_iter(&set, root);
+  iap_iter_seek(&it, root, 0xc0a90000U);
+  CHECK(!iap_iter_next(&it), "seek past last member returned member");
+  iap_free(&root);
+  iap_set_free(&set);
+
+  random_set(&set, UNIT_SET_SIZE);
+  if (!iap_set_tree(&set, &root)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  check_iter(&set, root);
+  iap_free(&root);
+  iap_set_free(&set);
+}
+
+/**
+ * write set as compiled file and load it back, return 1 if load succeeded
+ */
+static int iapb_roundtrip(const char *path, iap_pfx_t *v, size_t n,
+                          const iap_lpm_t *lpm, iap_set_t *out) {
+  iap_set_t set = {v, n, n};
+  const char *err;
+
+  if (!iapb_write(path, &set, lpm)) {
+    fprintf(stderr, "failed to write '%s'\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  return iapb_load(path, out, &err);
+}
+
+static void test_iapb(void) {
+  char path[] = "/tmp/iap-unit-XXXXXX";
+  iap_pfx_t good[] = {{0x0a000000U, 8}, {0x0b000000U, 24}},
+            bad_cidr[] = {{0x0a000000U, 40}},
+            bad_host[] = {{0x0a000001U, 8}},
+            unsorted[] = {{0x0b000000U, 8}, {0x0a000000U, 8}},
+            nested[] = {{0x0a000000U, 8}, {0x0a010000U, 16}},
+            after_end[] = {{0xff000000U, 8}, {0xff000000U, 8}};
+  iap_lpm_t lpm = {0};
+  iap_set_t set = {0};
+  int fd;
+
+  fd = mkstemp(path);
+  lpm.tbl24 = calloc((size_t)1 << 24, sizeof(unsigned int));
+  if (fd < 0 || !lpm.tbl24) {
+    fprintf(stderr, "failed to create test file\n");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  // hash of payload matches, prefixes are checked by load
+  CHECK(iapb_roundtrip(path, good, 2, (void *)0, &set), "load of valid set");
+  iap_set_free(&set);
+  CHECK(!iapb_roundtrip(path, bad_cidr, 1, (void *)0, &set),
+        "load of prefix longer than /32");
+  CHECK(!iapb_roundtrip(path, bad_host, 1, (void *)0, &set),
+        "load of prefix with host bits");
+  CHECK(!iapb_roundtrip(path, unsorted, 2, (void *)0, &set),
+        "load of unsorted set");
+  CHECK(!iapb_roundtrip(path, nested, 2, (void *)0, &set),
+        "load of nested prefixes");
+  CHECK(!iapb_roundtrip(path, after_end, 2, (void *)0, &set),
+        "load of prefix after end of address space");
+
+  // lookup table is checked when it is used
+  lpm.tbl24[0x0a0000] = 1;
+  lpm.tbl24[0x0b0000] = 2;
+  CHECK(iapb_roundtrip(path, good, 2, &lpm, &set) &&
+            iapb_check_index(set.map),
+        "valid lookup table rejected");
+  iap_set_free(&set);
+
+  lpm.tbl24[0x0c0000] = 3;
+  CHECK(iapb_roundtrip(path, good, 2, &lpm, &set) &&
+            !iapb_check_index(set.map),
+        "lookup table entry past end of set accepted");
+  iap_set_free(&set);
+
+  lpm.tbl24[0x0c0000] = IAP_LPM_EXT;
+  CHECK(iapb_roundtrip(path, good, 2, &lpm, &set) &&
+            !iapb_check_index(set.map),
+        "lookup table group past second level accepted");
+  iap_set_free(&set);
+
+  free(lpm.tbl24);
+  unlink(path);
+}
+
+int main(void) {
+  test_lookup_batch();
+  test_rank_select();
+  test_iter();
+  test_iapb();
+
+  if (failed) {
+    fprintf(stderr, "%d checks failed\n", failed);
+    return EXIT_FAILURE;
+  }
+
+  printf("unit tests passed\n");
+  return 0;
+}